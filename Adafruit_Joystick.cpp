@@ -19,7 +19,7 @@
 
 #include "Adafruit_Joystick.h"
 
-static int const _joy_calibration[5] = {
+static const int _joy_calibration[5] PROGMEM = {
     40,         /* down */
     204,        /* right */
     307,        /* select */
@@ -32,7 +32,7 @@ int Adafruit_Joystick::read()
     int val = analogRead(_pin);
 
     for (int i = 0; i < 5; i++)
-        if (val < _joy_calibration[i])
+        if (val < (int)pgm_read_word(&_joy_calibration[i]))
             return i+1;
 
     return 0;
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "Axis.h"
+
+Axis *Axis::_stop_list;
+
+/* Hook the endstop pin to an interrupt, if it has one.
+ *
+ * External interrupts (INTn) are preferred, then pin change
+ * interrupts (PCINTn). Returns false if the pin has neither,
+ * and must be polled.
+ */
+bool Axis::_endstop_irq(int pin)
+{
+#ifdef digitalPinToInterrupt
+    if (digitalPinToInterrupt(pin) != NOT_AN_INTERRUPT) {
+        attachInterrupt(digitalPinToInterrupt(pin), Axis::endstop_isr, CHANGE);
+        return true;
+    }
+#endif
+
+#ifdef digitalPinToPCICR
+    if (digitalPinToPCICR(pin)) {
+        *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+        *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+#if defined(__AVR__) && defined(digitalPinToPCICR)
+ISR(PCINT0_vect)
+{
+    Axis::endstop_isr();
+}
+
+ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect));
+#endif
+
+/* vim: set shiftwidth=4 expandtab:  */
@@ -19,6 +19,7 @@
 #define AXIS_H
 
 #include <stdint.h>
+#include <limits.h>
 #include <math.h>
 
 #define AXIS_MAX        4
@@ -27,20 +28,60 @@
 #define AXIS_Z          2
 #define AXIS_E          3
 
+/* Endstop latch bits, set from the endstop interrupt */
+#define AXIS_LATCH_MIN  (1 << 0)
+#define AXIS_LATCH_MAX  (1 << 1)
+
 class Axis {
     private:
         bool _enabled, _updated;
+        uint8_t _id;                    /* AXIS_* index, set by the CNC */
         int _pinStopMin;
         int _pinStopMax;
 
         unsigned int _velocityMax;
+
+        /* Per-axis unit conversions, precomputed by units_set() */
+        float _usteps_per_mm;
+        float _mm_per_ustep;
+        unsigned long _per_step_min;    /* usec/ustep at _velocityMax */
+
+        /* Endstop trips are latched here by Axis::endstop_isr(),
+         * and only cleared by endstop_rearm() once the switch
+         * has been seen open again.
+         */
+        volatile uint8_t _stop_latch;
+        bool _stop_polled;
+        Axis *_stop_next;
+        static Axis *_stop_list;
+
+        bool _endstop_irq(int pin);
+
+        void _endstop_sample()
+        {
+            if (_pinStopMin >= 0 && digitalRead(_pinStopMin) == 1)
+                _stop_latch |= AXIS_LATCH_MIN;
+            if (_pinStopMax >= 0 && digitalRead(_pinStopMax) == 1)
+                _stop_latch |= AXIS_LATCH_MAX;
+        }
+
     protected:
         struct {
-            float mm;
+            int32_t ustep;
             unsigned long ms;
-            unsigned int velocity;      /* mm/minute */
+            unsigned long per_step;     /* usec/ustep */
         } _target;
 
+        void units_set(float usteps_per_mm)
+        {
+            _usteps_per_mm = usteps_per_mm;
+            _mm_per_ustep = 1.0 / usteps_per_mm;
+            /* usec/ustep = usec/minute * minute/mm * mm/ustep */
+            _per_step_min = 60000000.0 / _velocityMax / usteps_per_mm;
+            if (_per_step_min < 1)
+                _per_step_min = 1;
+        }
+
     public:
         enum axis_stop_e {
             STOP_NONE = 0,
@@ -58,17 +99,85 @@ class Axis {
             _velocityMax = mm_per_minute_max ? mm_per_minute_max : 2000;
             _pinStopMin = pinStopMin;
             _pinStopMax = pinStopMax;
+            units_set(1000.0);          /* Default to 1um resolution */
+            _stop_latch = 0;
+            _stop_polled = false;
+            _stop_next = NULL;
+            _id = AXIS_MAX;
         }
 
         virtual void begin()
         {
-            if (_pinStopMin >= 0)
+            bool irq = true;
+
+            if (_pinStopMin >= 0) {
                 pinMode(_pinStopMin, INPUT_PULLUP);
-            if (_pinStopMax >= 0)
+                irq &= _endstop_irq(_pinStopMin);
+            }
+            if (_pinStopMax >= 0) {
                 pinMode(_pinStopMax, INPUT_PULLUP);
+                irq &= _endstop_irq(_pinStopMax);
+            }
+
+            if (_pinStopMin >= 0 || _pinStopMax >= 0) {
+                /* Pins without a pin change (or external) interrupt
+                 * are sampled by endstop_poll() instead.
+                 */
+                _stop_polled = !irq;
+                if (!_stop_next && _stop_list != this) {
+                    _stop_next = _stop_list;
+                    _stop_list = this;
+                }
+            }
+
+            _stop_latch = 0;
+            _endstop_sample();
             motor_enable(false);
         }
 
+        /* Called from the pin change interrupt vectors
+         * (or attachInterrupt()) when any endstop changes.
+         */
+        static void endstop_isr()
+        {
+            for (Axis *axis = _stop_list; axis; axis = axis->_stop_next)
+                axis->_endstop_sample();
+        }
+
+        /* Fast path - no pin reads, no float math.
+         * Returns the AXIS_LATCH_* bits latched since the last rearm.
+         */
+        uint8_t endstop_latched()
+        {
+            return _stop_latch;
+        }
+
+        /* For endstop pins that cannot interrupt, sample
+         * them. No-op for interrupt driven endstops.
+         */
+        void endstop_poll()
+        {
+            if (_stop_polled)
+                _endstop_sample();
+        }
+
+        /* Clear the latched trips for switches that are now open */
+        void endstop_rearm(uint8_t mask = AXIS_LATCH_MIN | AXIS_LATCH_MAX)
+        {
+            uint8_t open = 0;
+
+            if ((mask & AXIS_LATCH_MIN) &&
+                (_pinStopMin < 0 || digitalRead(_pinStopMin) == 0))
+                open |= AXIS_LATCH_MIN;
+            if ((mask & AXIS_LATCH_MAX) &&
+                (_pinStopMax < 0 || digitalRead(_pinStopMax) == 0))
+                open |= AXIS_LATCH_MAX;
+
+            noInterrupts();
+            _stop_latch &= ~open;
+            interrupts();
+        }
+
         bool endstop(enum axis_stop_e select, bool *is_physical = NULL)
         {
             int pin = -1;
@@ -113,6 +222,15 @@ class Axis {
             /* Recalibrate position - may or may not move axis */
         }
 
+        /* Fast seek rate, slow re-approach rate, and the distance
+         * to back off the endstop between the two.
+         */
+        virtual void homing_set(unsigned int fast_mm_per_min,
+                                unsigned int slow_mm_per_min,
+                                float backoff_mm)
+        {
+        }
+
         void home(float mm)
         {
             home();
@@ -141,41 +259,74 @@ class Axis {
         virtual bool motor_enabled() { return _enabled; }
         virtual bool motor_active() { return false; }
 
-        virtual void target_set(float mm, unsigned long ms = 0)
+        /* Closed loop axes fault when they cannot follow the target */
+        virtual bool fault() { return false; }
+
+        /* Conversion to and from the axis' native units.
+         * These should only be needed at the G-Code boundary.
+         */
+        float usteps_per_mm() { return _usteps_per_mm; }
+
+        int32_t mm_to_ustep(float mm)
         {
-            unsigned long mm_per_minute;
-            float mm_distance = fabs(mm - _target.mm);
+            float ustep = mm * _usteps_per_mm;
 
-            if (ms > 0) {
-                mm_per_minute = mm_distance * 60000 / ms;
-                if (mm_per_minute < 1)
-                    mm_per_minute = _velocityMax;
-                else if (mm_per_minute  > _velocityMax)
-                    mm_per_minute = _velocityMax;
-            } else {
-                mm_per_minute = _velocityMax;
+            return (int32_t)(ustep < 0 ? (ustep - 0.5) : (ustep + 0.5));
+        }
+
+        float ustep_to_mm(int32_t ustep)
+        {
+            return ustep * _mm_per_ustep;
+        }
+
+        void target_set(float mm, unsigned long ms = 0)
+        {
+            target_set_ustep(mm_to_ustep(mm), ms);
+        }
+
+        virtual void target_set_ustep(int32_t ustep, unsigned long ms = 0)
+        {
+            int32_t delta = ustep - _target.ustep;
+            unsigned long distance = (delta < 0) ? -delta : delta;
+            unsigned long per_step = _per_step_min;
+
+            if (ms > 0 && distance > 0) {
+                /* usec/ustep, no faster than the axis allows */
+                if (ms < (ULONG_MAX / 1000))
+                    per_step = ms * 1000 / distance;
+                else
+                    per_step = ms / distance * 1000;
+
+                if (per_step < _per_step_min)
+                    per_step = _per_step_min;
             }
 
-            _target.velocity = mm_per_minute;
-            _target.ms = millis() + mm_distance * mm_per_minute / 60 / 1000;
-            _target.mm = mm;
+            _target.per_step = per_step;
+            _target.ms = millis() + (distance / 1000) * per_step +
+                                    (distance % 1000) * per_step / 1000;
+            _target.ustep = ustep;
             _updated = false;
         }
 
-        virtual float target_get(unsigned long *ms_left = NULL)
+        float target_get(unsigned long *ms_left = NULL)
         {
             unsigned long now = millis();
 
             if (ms_left)
                 *ms_left = (now <= _target.ms) ? (_target.ms - now) : 0;
 
-            return _target.mm;
+            return ustep_to_mm(_target.ustep);
         }
 
+        void id_set(uint8_t id) { _id = id; }
+        uint8_t id() { return _id; }
+
         virtual float position_min(void) { return 0.0; }
         virtual float position_max(void) { return 200.0; }
 
-        virtual float position_get() { return _target.mm; }
+        virtual int32_t position_get_ustep() { return _target.ustep; }
+
+        float position_get() { return ustep_to_mm(position_get_ustep()); }
 };
 
 #endif /* AXIS_H */
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef AXIS_DCENCODER_H
+#define AXIS_DCENCODER_H
+
+#include <AFMotor.h>
+#include <Encoder.h>
+
+#include "config.h"
+#include "Axis.h"
+#include "timecmp.h"
+
+/* DC gearmotor on an Adafruit (v1) motor shield, closed loop
+ * on a quadrature encoder. One encoder count is one 'ustep'.
+ *
+ * Every DCENC_PID_US the position reference is advanced along
+ * the planned move, and the motor PWM is set from the planned
+ * velocity (feed-forward) plus a PID on the position error.
+ * If the error ever exceeds DCENC_FOLLOW_MM, the motor is
+ * released and the axis faults until re-enabled or homed.
+ */
+class Axis_DCEncoder : public Axis {
+    private:
+        AF_DCMotor _motor;
+        Encoder _encoder;
+
+        int32_t _maxPos;
+        static const int32_t _minPos = 0;
+        int32_t _follow_max;
+
+        enum {
+            IDLE,
+            HOMING,             /* Seek to the endstop */
+            MOVING,             /* Tracking the reference */
+            FAULT               /* Following error, motor released */
+        } _mode;
+        struct {
+            enum axis_stop_e pin;
+            uint8_t latch;
+            int32_t position;
+            int32_t seek;
+            unsigned long per_step_fast;
+            unsigned long per_step_slow;
+            int32_t backoff;
+        } _homing;
+
+        /* Reference trajectory, from -> to at per_step usec/count */
+        struct {
+            int32_t from, to;
+            unsigned long start;
+            unsigned long per_step;
+            bool done;
+        } _plan;
+
+        struct {
+            unsigned long next;
+            int32_t error;
+            float integral;
+            uint8_t settled;
+        } _pid;
+
+    public:
+        Axis_DCEncoder(int af_motor, int pinEncA, int pinEncB,
+                       int pinStopMin, int pinStopMax, unsigned int mm_per_min_max,
+                       float maxPosMM,
+                       unsigned int countsPerRotation, float mmPerRotation)
+            : Axis(pinStopMin, pinStopMax, mm_per_min_max),
+              _motor(af_motor), _encoder(pinEncA, pinEncB)
+        {
+            units_set(countsPerRotation / mmPerRotation);
+            _maxPos = mm_to_ustep(maxPosMM);
+            _follow_max = mm_to_ustep(DCENC_FOLLOW_MM);
+
+            if (pinStopMin >= 0) {
+                _homing.pin = Axis::STOP_MIN_SWITCH;
+                _homing.latch = AXIS_LATCH_MIN;
+                _homing.position = _minPos;
+                _homing.seek = -_maxPos;
+            } else if (pinStopMax >= 0) {
+                _homing.pin = Axis::STOP_MAX_SWITCH;
+                _homing.latch = AXIS_LATCH_MAX;
+                _homing.position = _maxPos;
+                _homing.seek = _maxPos;
+            } else {
+                _homing.pin = Axis::STOP_NONE;
+                _homing.latch = 0;
+                _homing.seek = 0;
+            }
+
+            homing_set(1000, 1000, 0.0);
+
+            _mode = IDLE;
+            _plan.from = _plan.to = 0;
+            _plan.per_step = 1;
+            _plan.done = true;
+        }
+
+        virtual void home()
+        {
+            Axis::home();
+
+            /* Homing clears a following error fault, and then
+             * re-references the axis like any other homing.
+             */
+            _hold(_encoder.read());
+            if (_homing.seek == 0)
+                return;
+
+            /* Seek past the far end of travel, until the
+             * endstop latches. The encoder is zeroed there.
+             */
+            endstop_rearm(_homing.latch);
+            _plan_set(_reference(micros()), _encoder.read() + _homing.seek,
+                      _homing.per_step_fast);
+            _mode = HOMING;
+        }
+
+        virtual void homing_set(unsigned int fast_mm_per_min,
+                                unsigned int slow_mm_per_min,
+                                float backoff_mm)
+        {
+            if (fast_mm_per_min < 1)
+                fast_mm_per_min = 1;
+            if (slow_mm_per_min < 1)
+                slow_mm_per_min = 1;
+
+            /* usec/count = usec/minute * minute/mm * mm/count */
+            _homing.per_step_fast = 60000000UL / fast_mm_per_min / usteps_per_mm();
+            _homing.per_step_slow = 60000000UL / slow_mm_per_min / usteps_per_mm();
+            _homing.backoff = mm_to_ustep(backoff_mm);
+        }
+
+        virtual float position_min()
+        {
+            return ustep_to_mm(_minPos);
+        }
+
+        virtual float position_max()
+        {
+            return ustep_to_mm(_maxPos);
+        }
+
+        virtual void motor_enable(bool enabled = true)
+        {
+            if (!enabled) {
+                _motor.run(RELEASE);
+                _hold(_encoder.read());
+            } else if (_mode == FAULT) {
+                /* Re-enabling clears a following error fault */
+                _hold(_encoder.read());
+            }
+            Axis::motor_enable(enabled);
+        }
+
+        virtual bool motor_active()
+        {
+            return _mode == HOMING || _mode == MOVING;
+        }
+
+        virtual bool fault()
+        {
+            return _mode == FAULT;
+        }
+
+        virtual int32_t position_get_ustep(void)
+        {
+            return _encoder.read();
+        }
+
+        virtual void target_set_ustep(int32_t ustep, unsigned long ms = 0)
+        {
+            Axis::target_set_ustep(ustep, ms);
+
+            if (_mode == FAULT || _mode == HOMING)
+                return;
+
+            if (ustep >= _maxPos)
+                ustep = _maxPos - 1;
+            if (ustep < _minPos)
+                ustep = _minPos;
+
+            /* Start from where the reference is now, so that
+             * back to back moves do not jerk the motor.
+             */
+            _plan_set(_reference(micros()), ustep, _target.per_step);
+            endstop_rearm();
+            _mode = MOVING;
+        }
+
+        virtual bool update(unsigned long us_now)
+        {
+            int32_t ref, pos;
+
+            if (_mode == IDLE || _mode == FAULT)
+                return false;
+
+            if (time_before(us_now, _pid.next)) {
+                time_deadline(_pid.next);
+                return true;
+            }
+
+            _pid.next += DCENC_PID_US;
+            if (time_before(_pid.next, us_now))
+                _pid.next = us_now + DCENC_PID_US;
+            time_deadline(_pid.next);
+
+            pos = _encoder.read();
+
+            endstop_poll();
+            if (_mode == HOMING) {
+                if (endstop_latched() & _homing.latch) {
+                    /* Zero here, and back off the switch */
+                    _encoder.write(_homing.position);
+                    endstop_rearm(_homing.latch);
+                    _plan_set(_homing.position, (_homing.seek < 0) ?
+                              (_homing.position + _homing.backoff) :
+                              (_homing.position - _homing.backoff),
+                              _homing.per_step_slow);
+                    _pid.integral = 0;
+                    _pid.error = 0;
+                    _mode = MOVING;
+                    return true;
+                }
+            } else {
+                /* Hard stops are latched by the endstop interrupt */
+                if ((_plan.to > pos && (endstop_latched() & AXIS_LATCH_MAX)) ||
+                    (_plan.to < pos && (endstop_latched() & AXIS_LATCH_MIN))) {
+                    _motor.run(BRAKE);
+                    _hold(pos);
+                    return false;
+                }
+            }
+
+            ref = _reference(us_now);
+            if (_pid_step(ref, pos))
+                return true;
+
+            _motor.run(RELEASE);
+            _mode = FAULT;
+            return false;
+        }
+
+    private:
+        /* Reference position at time 'us_now', along the plan */
+        int32_t _reference(unsigned long us_now)
+        {
+            unsigned long dist, done;
+
+            if (_plan.done)
+                return _plan.to;
+
+            dist = (_plan.to > _plan.from) ? (_plan.to - _plan.from) : (_plan.from - _plan.to);
+            done = (us_now - _plan.start) / _plan.per_step;
+            if (done >= dist) {
+                _plan.done = true;
+                return _plan.to;
+            }
+
+            return (_plan.to > _plan.from) ? (_plan.from + done) : (_plan.from - done);
+        }
+
+        void _plan_set(int32_t from, int32_t to, unsigned long per_step)
+        {
+            unsigned long now = micros();
+
+            _plan.from = from;
+            _plan.to = to;
+            _plan.per_step = per_step ? per_step : 1;
+            _plan.start = now;
+            _plan.done = (from == to);
+
+            if (_mode != MOVING && _mode != HOMING) {
+                _pid.next = now;
+                _pid.error = 0;
+                _pid.integral = 0;
+            }
+            _pid.settled = 0;
+        }
+
+        /* Stop servoing, with the reference at 'pos' */
+        void _hold(int32_t pos)
+        {
+            _plan.from = _plan.to = pos;
+            _plan.done = true;
+            _mode = IDLE;
+        }
+
+        /* One PID period. Returns false on a following error */
+        bool _pid_step(int32_t ref, int32_t pos)
+        {
+            const float dt = DCENC_PID_US / 1000000.0;
+            int32_t error = ref - pos;
+            float vel, out, i_max;
+            int pwm;
+
+            if (error > _follow_max || error < -_follow_max)
+                return false;
+
+            if (_plan.done && error <= DCENC_SETTLE && error >= -DCENC_SETTLE) {
+                /* Let the gearbox hold it, once it stays put */
+                if (++_pid.settled >= DCENC_SETTLE_TICKS) {
+                    _motor.run(BRAKE);
+                    _motor.setSpeed(0);
+                    _mode = IDLE;
+                    return true;
+                }
+            } else {
+                _pid.settled = 0;
+            }
+
+            /* Planned velocity, in counts/second */
+            vel = _plan.done ? 0.0 : (1000000.0 / _plan.per_step);
+            if (_plan.to < _plan.from)
+                vel = -vel;
+
+            _pid.integral += error * dt;
+            i_max = DCENC_I_MAX / DCENC_KI;
+            if (_pid.integral > i_max)
+                _pid.integral = i_max;
+            else if (_pid.integral < -i_max)
+                _pid.integral = -i_max;
+
+            out = DCENC_KFF * vel +
+                  DCENC_KP * error +
+                  DCENC_KI * _pid.integral +
+                  DCENC_KD * (error - _pid.error) / dt;
+            _pid.error = error;
+
+            pwm = DCENC_PWM_MIN + (int)fabs(out);
+            if (pwm > 255)
+                pwm = 255;
+
+            _motor.setSpeed(pwm);
+            _motor.run(out < 0 ? BACKWARD : FORWARD);
+
+            return true;
+        }
+};
+
+#endif /* AXIS_DCENCODER_H */
+/* vim: set shiftwidth=4 expandtab:  */
@@ -18,7 +18,12 @@
 #ifndef AXIS_STEPPER_H
 #define AXIS_STEPPER_H
 
+#include <Encoder.h>
+
+#include "config.h"
 #include "Axis.h"
+#include "timecmp.h"
+#include "Trace.h"
 
 class Axis_Stepper : public Axis {
     private:
@@ -29,26 +34,41 @@ class Axis_Stepper : public Axis {
         int32_t _maxPos;
         static const int32_t _minPos = 0;
 
-        float _usteps_per_mm;
         int32_t _position;
         int32_t _target_position;
 
         enum {
             IDLE,
-            HOMING, HOMING_QUIESCE,
-            HOMING_BACKOFF,
+            HOMING,             /* Fast seek to the endstop */
+            HOMING_QUIESCE,
+            HOMING_BACKOFF,     /* Slow back off, until open */
+            HOMING_LOCATE,      /* Slow re-approach to the endstop */
             MOVING
         } _mode;
         struct {
             unsigned long timeout;
             int steps;
             enum axis_stop_e pin;
+            uint8_t latch;
             int32_t position;
+            unsigned long per_step_fast;
+            unsigned long per_step_slow;
+            int32_t backoff, count;
+            bool located;
         } _homing;
         struct {
             unsigned long timeout;
         } _moving;
 
+        /* Optional encoder, to cross-check the step count */
+        struct {
+            Encoder *encoder;
+            float usteps_per_count;
+            int32_t tolerance;          /* usteps */
+            uint8_t retry;
+            bool fault;
+        } _enc;
+
         struct {
             unsigned long last;
             unsigned long this_step;
@@ -59,27 +79,35 @@ class Axis_Stepper : public Axis {
         Axis_Stepper(int pinStopMin, int pinStopMax, unsigned int mm_per_min_max,
                      float maxPosMM, unsigned int microSteps,
                      unsigned int stepsPerRotation, float mmPerRotation)
-            : Axis(pinStopMin, pinStopMax)
+            : Axis(pinStopMin, pinStopMax, mm_per_min_max)
         {
             _microSteps = microSteps;
             _stepsPerRotation = stepsPerRotation;
             _mmPerRotation = mmPerRotation;
-            _usteps_per_mm = _stepsPerRotation * _microSteps / _mmPerRotation;
-            _maxPos = maxPosMM * _usteps_per_mm;
+            units_set(_stepsPerRotation * _microSteps / _mmPerRotation);
+            _maxPos = mm_to_ustep(maxPosMM);
 
             _position = 0;
             if (pinStopMin >= 0) {
                 _homing.steps = -microSteps;
                 _homing.pin = Axis::STOP_MIN_SWITCH;
+                _homing.latch = AXIS_LATCH_MIN;
                 _homing.position = _minPos;
             } else if (pinStopMax >= 0) {
                 _homing.steps = microSteps;
                 _homing.pin = Axis::STOP_MAX_SWITCH;
+                _homing.latch = AXIS_LATCH_MAX;
                 _homing.position = _maxPos;
             } else {
                 _homing.steps = 0;
                 _homing.pin = Axis::STOP_NONE;
+                _homing.latch = 0;
             }
+
+            homing_set(1000, 1000, 0.0);
+
+            _enc.encoder = NULL;
+            _enc.fault = false;
         }
 
         /* Required to be implemented by your base class.
@@ -91,21 +119,74 @@ class Axis_Stepper : public Axis {
          */
         virtual int step(int32_t steps) = 0;
 
+        /* Cross-check the step count against an encoder with
+         * 'counts_per_mm', at the end of every segment. Lost (or
+         * gained) steps beyond STEP_LOST_MM are made up from the
+         * encoder position when STEP_LOST_CORRECT is set, up to
+         * STEP_LOST_RETRY times, else the axis faults.
+         */
+        void encoder_set(Encoder *encoder, float counts_per_mm)
+        {
+            _enc.encoder = encoder;
+            _enc.usteps_per_count = usteps_per_mm() / counts_per_mm;
+            _enc.tolerance = mm_to_ustep(STEP_LOST_MM);
+            _enc.retry = 0;
+            _enc.fault = false;
+            _enc_sync();
+        }
+
+        virtual bool fault()
+        {
+            return _enc.fault;
+        }
+
+        virtual void motor_enable(bool enabled = true)
+        {
+            /* Re-enabling resumes a faulted axis from where
+             * its encoder says it is.
+             */
+            if (enabled && _enc.fault) {
+                _position = _enc_position();
+                _enc.retry = 0;
+                _enc.fault = false;
+            }
+            Axis::motor_enable(enabled);
+        }
+
         virtual void home()
         {
             Axis::home();
 
+            _enc.fault = false;
+            endstop_rearm(_homing.latch);
+            _udelay.per_step = _homing.per_step_fast;
+            _homing.located = false;
             _mode = HOMING;
         }
 
+        virtual void homing_set(unsigned int fast_mm_per_min,
+                                unsigned int slow_mm_per_min,
+                                float backoff_mm)
+        {
+            if (fast_mm_per_min < 1)
+                fast_mm_per_min = 1;
+            if (slow_mm_per_min < 1)
+                slow_mm_per_min = 1;
+
+            /* usec/ustep = usec/minute * minute/mm * mm/ustep */
+            _homing.per_step_fast = 60000000UL / fast_mm_per_min / usteps_per_mm();
+            _homing.per_step_slow = 60000000UL / slow_mm_per_min / usteps_per_mm();
+            _homing.backoff = mm_to_ustep(backoff_mm);
+        }
+
         virtual float position_min()
         {
-            return _minPos / _usteps_per_mm;
+            return ustep_to_mm(_minPos);
         }
 
         virtual float position_max()
         {
-            return _maxPos / _usteps_per_mm;
+            return ustep_to_mm(_maxPos);
         }
 
         virtual bool motor_active()
@@ -113,18 +194,18 @@ class Axis_Stepper : public Axis {
             return _mode != IDLE;
         }
 
-        virtual float position_get(void)
+        virtual int32_t position_get_ustep(void)
         {
-            return _position / _usteps_per_mm;
+            return _position;
         }
 
-        virtual void target_set(float mm, unsigned long ms = 0)
+        virtual void target_set_ustep(int32_t ustep, unsigned long ms = 0)
         {
-            Axis::target_set(mm, ms);
+            Axis::target_set_ustep(ustep, ms);
 
-            _target_position = mm * _usteps_per_mm;
-            /* usec/ustep = usec/minute * minute/mm * mm/ustep */
-            _udelay.per_step = 60000000UL / _target.velocity /  _usteps_per_mm;
+            _target_position = ustep;
+            _udelay.per_step = _target.per_step;
+            _enc.retry = 0;
         }
 
         virtual bool update(unsigned long us_now)
@@ -140,61 +221,93 @@ class Axis_Stepper : public Axis {
                 if (tar < _minPos)
                     tar = _minPos;
 
-                if (tar != pos) {
+                if (tar != pos && !_enc.fault) {
+                    endstop_rearm();
                     _udelay.last = us_now;
                     _udelay.this_step = 0;
                     _mode = MOVING;
                 }
                 break;
             case HOMING:
+            case HOMING_LOCATE:
                 if (_homing.steps == 0) {
                     _mode = IDLE;
                     break;
                 }
-                if (endstop(_homing.pin)) {
+                endstop_poll();
+                if (endstop_latched() & _homing.latch) {
                     _homing.timeout = us_now+1000;
+                    _homing.located = (_mode == HOMING_LOCATE);
                     _mode = HOMING_QUIESCE;
                 } else {
                     _step(_homing.steps);
                 }
                 break;
             case HOMING_QUIESCE:
+                time_deadline(_homing.timeout);
                 if (us_now >= _homing.timeout) {
-                    _mode = HOMING_BACKOFF;
-                    _homing.timeout = us_now+10000;
+                    /* Back off the full distance after the fast seek,
+                     * only until the switch opens after the slow one.
+                     */
+                    _homing.count = _homing.located ? 0 : _homing.backoff;
+                    _udelay.per_step = _homing.per_step_slow;
                     _mode = HOMING_BACKOFF;
                 }
                 break;
             case HOMING_BACKOFF:
-                if (us_now >= _homing.timeout) {
-                    if (endstop(_homing.pin)) {
-                        /* If we are still on the endstop, back slowly */
-                        if (!_step(_homing.steps > 0 ? -1 : 1))
-                            break;
-                        _homing.timeout = us_now+10000;
-                    } else {
-                        _position = _homing.position;
-                        _mode = IDLE;
-                    }
+                if (endstop(_homing.pin)) {
+                    _step(_homing.steps > 0 ? -1 : 1);
+                    break;
+                }
+
+                if (_homing.count > 0) {
+                    if (_step(_homing.steps > 0 ? -1 : 1))
+                        _homing.count--;
+                    break;
+                }
+
+                endstop_rearm(_homing.latch);
+                if (_homing.located || _homing.backoff == 0) {
+                    _position = _homing.position;
+                    _enc_sync();
+                    _mode = IDLE;
+                } else {
+                    _mode = HOMING_LOCATE;
                 }
                 break;
             case MOVING:
-                if (tar > pos && endstop(Axis::STOP_MAX)) {
+                /* Hard stops are latched by the endstop interrupt,
+                 * soft stops are integer step bounds.
+                 *
+                 * The ISR only latches; it does not touch the motor.
+                 * Steps are only ever issued from this update(), and
+                 * the latch is tested before every one, so no step is
+                 * taken after the trip. Stepping from the ISR would
+                 * race the motor driver calls made here.
+                 */
+                endstop_poll();
+                if (tar > pos && ((endstop_latched() & AXIS_LATCH_MAX) ||
+                                  pos >= _maxPos)) {
                     _position = _maxPos;
+                    _target_position = _position;
+                    _enc_sync();
                     _mode = IDLE;
                     break;
                 }
 
-                if (tar < pos && endstop(Axis::STOP_MIN)) {
+                if (tar < pos && ((endstop_latched() & AXIS_LATCH_MIN) ||
+                                  pos <= _minPos)) {
                     _position = _minPos;
+                    _target_position = _position;
+                    _enc_sync();
                     _mode = IDLE;
                     break;
                 }
 
-                if (pos == tar)
-                    _mode = IDLE;
-                else
+                if (pos != tar)
                     _step(tar-pos);
+                else if (!_enc_check() || _position == tar)
+                    _mode = IDLE;
 
                 break;
             }
@@ -203,17 +316,68 @@ class Axis_Stepper : public Axis {
         }
 
     private:
+        int32_t _enc_position()
+        {
+            float ustep = _enc.encoder->read() * _enc.usteps_per_count;
+
+            return (int32_t)(ustep < 0 ? (ustep - 0.5) : (ustep + 0.5));
+        }
+
+        /* The step count is known good, set the encoder to match */
+        void _enc_sync()
+        {
+            float count;
+
+            if (!_enc.encoder)
+                return;
+
+            count = _position / _enc.usteps_per_count;
+            _enc.encoder->write((int32_t)(count < 0 ? (count - 0.5) : (count + 0.5)));
+        }
+
+        /* End of segment check. Returns false if the axis faulted,
+         * else _position may have been corrected, and the segment
+         * needs more steps.
+         */
+        bool _enc_check()
+        {
+            int32_t actual, lost;
+
+            if (!_enc.encoder)
+                return true;
+
+            actual = _enc_position();
+            lost = _position - actual;
+            if (lost <= _enc.tolerance && lost >= -_enc.tolerance)
+                return true;
+
+            if (STEP_LOST_CORRECT && _enc.retry < STEP_LOST_RETRY) {
+                _enc.retry++;
+                _position = actual;
+                return true;
+            }
+
+            _position = actual;
+            _enc.fault = true;
+            return false;
+        }
+
         bool _step(int32_t steps)
         {
             unsigned long usec_now = micros();
             if ((usec_now - _udelay.last) >= _udelay.this_step) {
                 int stepped;
                 stepped = step(steps);
+                if (stepped)
+                    trace_step(id(), stepped,
+                               _udelay.last + _udelay.this_step, usec_now);
                 _position += stepped;
                 _udelay.this_step = (unsigned long)abs(stepped) * _udelay.per_step;
                 _udelay.last = micros();
+                time_deadline(_udelay.last + _udelay.this_step);
                 return true;
             }
+            time_deadline(_udelay.last + _udelay.this_step);
             return false;
         }
 };
@@ -24,6 +24,8 @@
 #endif
 
 #include "GCode.h"
+#include "Memory.h"
+#include "Profile.h"
 #include "Axis.h"
 #include "ToolHead.h"
 
@@ -39,8 +41,10 @@
 #include "Axis_AF1Stepper.h"
 #include "Axis_AF2Stepper.h"
 #include "Axis_A4988.h"
+#include "Axis_DCEncoder.h"
 
 #include "InkBar.h"
+#include "InkHeads.h"
 #include "ToolFuser.h"
 
 #if ENABLE_AXIS_X
@@ -49,8 +53,18 @@ X_MOTOR(axisX);
 Axis axisX;
 #endif
 
+#if ENABLE_AXIS_X && defined(X_ENC_A) && !defined(X_ENC_MOTOR)
+Encoder encoderX(X_ENC_A, X_ENC_B);
+#endif
+
+ToolHead tools;
+
 #if ENABLE_AXIS_Y
-Y_MOTOR(axisY);
+Y_MOTOR(inkBlack);
+#if ENABLE_INK_AUX
+Y_MOTOR_AUX(inkAux);
+#endif
+InkHeads axisY(&tools);
 #else
 Axis axisY;
 Tool toolInk_Black;
@@ -62,12 +76,20 @@ Z_MOTOR(axisZ);
 Axis axisZ;
 #endif
 
+#if ENABLE_AXIS_Z && defined(Z_ENC_A)
+Encoder encoderZ(Z_ENC_A, Z_ENC_B);
+#endif
+
 #if ENABLE_AXIS_E
 E_MOTOR(axisE);
 #else
 Axis axisE;
 #endif
 
+#if ENABLE_AXIS_E && defined(E_ENC_A)
+Encoder encoderE(E_ENC_A, E_ENC_B);
+#endif
+
 #if ENABLE_TOOL_FUSER
 FUSER(toolFuser);
 #else
@@ -77,7 +99,6 @@ Tool toolFuser;
 Tool toolRecoat;
 Tool toolBedTemp;
 
-ToolHead tools;
 CNC cnc = CNC(&axisX, &axisY, &axisZ, &axisE, &tools);
 
 #if ENABLE_UI
@@ -97,13 +118,18 @@ GCode gcode = GCode(&Serial, &cnc);
 
 void setup()
 {
+    memory_paint();
+
     Serial.begin(SERIAL_SPEED);
 #if ENABLE_SD
     SD.begin(SD_CS);
 #endif
 
 #if ENABLE_AXIS_Y
-    tools.attach(TOOL_INK_BLACK, (Tool *)&axisY);
+    axisY.attach(TOOL_INK_BLACK, &inkBlack);
+#if ENABLE_INK_AUX
+    axisY.attach(TOOL_INK_AUX, &inkAux);
+#endif
 #else
     tools.attach(TOOL_INK_BLACK, &toolInk_Black);
 #endif
@@ -131,6 +157,20 @@ void setup()
     vis.origin(198, 0, 0);
 #endif
 
+    axisX.homing_set(X_HOME_FAST, X_HOME_SLOW, X_HOME_BACKOFF);
+    axisZ.homing_set(Z_HOME_FAST, Z_HOME_SLOW, Z_HOME_BACKOFF);
+    axisE.homing_set(E_HOME_FAST, E_HOME_SLOW, E_HOME_BACKOFF);
+
+#if ENABLE_AXIS_X && defined(X_ENC_A) && !defined(X_ENC_MOTOR)
+    axisX.encoder_set(&encoderX, X_ENC_COUNTS / X_TURN_MM);
+#endif
+#if ENABLE_AXIS_Z && defined(Z_ENC_A)
+    axisZ.encoder_set(&encoderZ, Z_ENC_COUNTS / Z_TURN_MM);
+#endif
+#if ENABLE_AXIS_E && defined(E_ENC_A)
+    axisE.encoder_set(&encoderE, E_ENC_COUNTS / E_TURN_MM);
+#endif
+
     axisX.begin();
     axisY.begin();
     axisZ.begin();
@@ -170,6 +210,7 @@ static enum ui_key keymap(int joy)
 void loop()
 {
     unsigned long us_now = micros();
+    PROFILE_START(PROFILE_LOOP);
 #if ENABLE_UI
     enum ui_key key;
     bool cnc_active, ui_active;
@@ -177,18 +218,35 @@ void loop()
     cnc_active = cnc.update(us_now);
 
     if (!cnc_active) {
+        PROFILE_START(PROFILE_UI);
         key = keymap(joy.read());
 
         ui_active = ui.update(key);
+        PROFILE_STOP(PROFILE_UI);
     } else {
         ui_active = false;
     }
 
-    if (!ui_active)
+    if (!ui_active) {
+        PROFILE_START(PROFILE_GCODE);
         gcode.update(cnc_active);
+        PROFILE_STOP(PROFILE_GCODE);
+    }
+
+    /* Draw the toolpath preview only when motion can spare the time */
+    if (!cnc_active || gcode.queue_used() >= VIS_QUEUE_MIN) {
+        PROFILE_START(PROFILE_VIS);
+        vis.update(VIS_SLICE_US);
+        PROFILE_STOP(PROFILE_VIS);
+    }
 #else
-    gcode.update(cnc.update(us_now));
+    bool cnc_active = cnc.update(us_now);
+
+    PROFILE_START(PROFILE_GCODE);
+    gcode.update(cnc_active);
+    PROFILE_STOP(PROFILE_GCODE);
 #endif
+    PROFILE_STOP(PROFILE_LOOP);
 }
 
 /* vim: set shiftwidth=4 expandtab:  */
@@ -22,6 +22,7 @@
 
 #include "Axis.h"
 #include "ToolHead.h"
+#include "Profile.h"
 
 #define CNC_STATUS_MAX           32
 #define CNC_MESSAGE_MAX          32
@@ -30,6 +31,12 @@
 
 #define CNC_BUTTON_CYCLE_START   0
 
+/* Target positions are kept in fixed point microsteps,
+ * with this many fractional bits, so that relative moves
+ * do not accumulate rounding errors.
+ */
+#define CNC_USTEP_SHIFT          8
+
 class CNC {
     private:
         Axis *_axis[AXIS_MAX];
@@ -41,7 +48,17 @@ class CNC {
         char _status[CNC_STATUS_MAX];
         char _message[CNC_MESSAGE_MAX];
         bool _message_updated;
-        float _pos[AXIS_MAX];
+        int32_t _pos[AXIS_MAX];         /* usteps << CNC_USTEP_SHIFT */
+
+        struct {
+            float q_per_mm;
+            float mm_per_q;
+        } _scale[AXIS_MAX];
+
+        struct {
+            int tool;
+            int32_t pos[AXIS_MAX];      /* usteps << CNC_USTEP_SHIFT */
+        } _offset;
 
         Stream *_serial[4];
 
@@ -57,10 +74,19 @@ class CNC {
             _axis[AXIS_Z] = z;
             _axis[AXIS_E] = e;
             _toolhead = t;
+
+            for (int i = 0; i < AXIS_MAX; i++)
+                _axis[i]->id_set(i);
         }
 
         void begin()
         {
+            for (int i = 0; i < AXIS_MAX; i++) {
+                _scale[i].q_per_mm = _axis[i]->usteps_per_mm() * (1L << CNC_USTEP_SHIFT);
+                _scale[i].mm_per_q = 1.0 / _scale[i].q_per_mm;
+            }
+
+            _offset.tool = -1;
         }
 
         void serial_set(int id, Stream *stream)
@@ -82,24 +108,22 @@ class CNC {
 
         void target_move(float *pos, uint8_t axis_mask, unsigned long ms = 0)
         {
-            const float *offset = tool()->offset_is();
-
             for (int i = 0; i < AXIS_MAX; i++) {
                 if (axis_mask & (1 << i))
-                    _pos[i] += pos[i];
-                _axis[i]->target_set(_pos[i] - offset[i], ms);
+                    _pos[i] += _mm_to_q(i, pos[i]);
             }
+
+            _target_update(ms);
         }
 
         void target_set(float *pos, uint8_t axis_mask, unsigned long ms = 0)
         {
-            const float *offset = tool()->offset_is();
-
             for (int i = 0; i < AXIS_MAX; i++) {
                 if (axis_mask & (1 << i))
-                    _pos[i] = pos[i];
-                _axis[i]->target_set(_pos[i] - offset[i], ms);
+                    _pos[i] = _mm_to_q(i, pos[i]);
             }
+
+            _target_update(ms);
         }
 
         void target_move_rate(float *pos, uint8_t axis_mask, float feed_rate)
@@ -122,16 +146,22 @@ class CNC {
 
             for (int i = 0; i < AXIS_MAX; i++) {
                 if (axis_mask & (1 << i)) {
-                    float delta = pos[i] - _pos[i];
+                    int32_t q = _mm_to_q(i, pos[i]);
+                    float delta = (q - _pos[i]) * _scale[i].mm_per_q;
                     dist += delta * delta;
+                    _pos[i] = q;
                 }
             }
 
             unsigned long ms = sqrt(dist) / feed_rate * 60000.0;
 
-            target_set(pos, axis_mask, ms);
+            _target_update(ms);
         }
 
+        /* All selected axes home concurrently, each one
+         * is stepped through its own seek/backoff/locate
+         * cycle by update().
+         */
         void home(uint8_t axis_mask = 0xff)
         {
             for (int i = 0; i < AXIS_MAX; i++) {
@@ -143,7 +173,7 @@ class CNC {
         void target_get(float *pos)
         {
             for (int i = 0; i < AXIS_MAX; i++)
-                pos[i] = _pos[i];
+                pos[i] = _pos[i] * _scale[i].mm_per_q;
         }
 
         void position_get(float *pos)
@@ -226,6 +256,18 @@ class CNC {
             return active;
         }
 
+        /* Mask of the axes that have faulted */
+        uint8_t axis_fault()
+        {
+            uint8_t mask = 0;
+
+            for (int i = 0; i < AXIS_MAX; i++)
+                if (_axis[i]->fault())
+                    mask |= (1 << i);
+
+            return mask;
+        }
+
         bool axis_endstop(int axis, enum Axis::axis_stop_e stop, bool *is_phys = NULL)
         {
             return _axis[axis]->endstop(stop, is_phys);
@@ -234,7 +276,7 @@ class CNC {
         void axis_motor(bool enabled, uint8_t axis_mask = 0xff)
         {
             for (int i = 0; i < AXIS_MAX; i++)
-                if ((1 << i) && axis_mask)
+                if ((1 << i) & axis_mask)
                     _axis[i]->motor_enable(enabled);
         }
 
@@ -251,7 +293,7 @@ class CNC {
         void stop()
         {
             axis_disable();
-            _toolhead->tool()->stop();
+            _toolhead->halt();
         }
 
         void status_set(const char *message)
@@ -329,6 +371,7 @@ class CNC {
                 return false;
 
             t->offset_set(pos, axis_mask);
+            _offset.tool = -1;
 
             return true;
         }
@@ -337,14 +380,44 @@ class CNC {
         {
             bool motion = false;
 
+            PROFILE_START(PROFILE_AXIS);
             for (int i = 0; i < AXIS_MAX; i++)
                 motion |= _axis[i]->update(us_now);
+            PROFILE_STOP(PROFILE_AXIS);
 
-            if (motion)
-                tool()->update(us_now);
+            PROFILE_START(PROFILE_TOOL);
+            _toolhead->update(us_now);
+            PROFILE_STOP(PROFILE_TOOL);
 
             return motion;
         }
+
+    private:
+        int32_t _mm_to_q(int axis, float mm)
+        {
+            float q = mm * _scale[axis].q_per_mm;
+
+            return (int32_t)(q < 0 ? (q - 0.5) : (q + 0.5));
+        }
+
+        /* Send the (tool offset adjusted) target to all axes */
+        void _target_update(unsigned long ms)
+        {
+            const int32_t round = (1L << CNC_USTEP_SHIFT) / 2;
+
+            if (_offset.tool != _toolhead->selected()) {
+                const float *offset = tool()->offset_is();
+
+                for (int i = 0; i < AXIS_MAX; i++)
+                    _offset.pos[i] = _mm_to_q(i, offset[i]);
+                _offset.tool = _toolhead->selected();
+            }
+
+            for (int i = 0; i < AXIS_MAX; i++) {
+                int32_t q = _pos[i] - _offset.pos[i];
+                _axis[i]->target_set_ustep((q + round) >> CNC_USTEP_SHIFT, ms);
+            }
+        }
 };
 
 #endif /* CNC_H */
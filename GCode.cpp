@@ -20,6 +20,10 @@
 #include <Wire.h>
 
 #include "GCode.h"
+#include "pinout.h"
+#include "Memory.h"
+#include "Trace.h"
+#include "Profile.h"
 
 static void _line_reset(struct gcode_line *line)
 {
@@ -57,7 +61,10 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
     } data;
     int is_cs = 0, i, ipart = 0, fpart = 0, fbase = 0;
     int neg = 1;
+    bool string_long = false;
     struct gcode_block state = { 0 };
+    float word[GCODE_WORD_MAX];
+    int n;
 
     data.fptr = NULL;
 
@@ -75,10 +82,14 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
             if (isspace(c) && ipart == 0)
                 continue;
 
-            if (ipart < (int)sizeof(state.string)-1) {
-                state.string[ipart++] = c;
-                continue;
-            }
+            /* Text past the end of the arena is swallowed, never
+             * parsed as words; the block is answered as an error.
+             */
+            if (ipart < (int)sizeof(_string)-1)
+                _string[ipart++] = c;
+            else
+                string_long = true;
+            continue;
         } else {
             if (mode == FLOAT && c == '.') {
                 fbase = 1;
@@ -116,7 +127,7 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
             *data.fptr = neg * (float)ipart + ((float)fpart / (float)fbase);
             break;
         case STRING:
-            state.string[ipart] = 0;
+            _string[ipart] = 0;
             break;
         case INVALID:
             break;
@@ -134,6 +145,7 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
                     state.cmd == 32 ||
                     state.cmd == 36 ||
                     state.cmd == 117 ||
+                    state.cmd == 470 ||
                     state.cmd == 490 ||
                     state.cmd == 491 ||
                     state.cmd == 492 ||
@@ -163,67 +175,67 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
             break;
         case 'I':
             mode = FLOAT;
-            data.fptr = &state.i;
+            data.fptr = &word[GCODE_WORD_I];
             state.update_mask |= GCODE_UPDATE_I;
             break;
         case 'J':
             mode = FLOAT;
-            data.fptr = &state.j;
+            data.fptr = &word[GCODE_WORD_J];
             state.update_mask |= GCODE_UPDATE_J;
             break;
         case 'K':
             mode = FLOAT;
-            data.fptr = &state.k;
+            data.fptr = &word[GCODE_WORD_K];
             state.update_mask |= GCODE_UPDATE_K;
             break;
         case 'L':
             mode = FLOAT;
-            data.fptr = &state.l;
+            data.fptr = &word[GCODE_WORD_L];
             state.update_mask |= GCODE_UPDATE_L;
             break;
         case 'P':
             mode = FLOAT;
-            data.fptr = &state.p;
+            data.fptr = &word[GCODE_WORD_P];
             state.update_mask |= GCODE_UPDATE_P;
             break;
         case 'Q':
             mode = FLOAT;
-            data.fptr = &state.q;
+            data.fptr = &word[GCODE_WORD_Q];
             state.update_mask |= GCODE_UPDATE_Q;
             break;
         case 'R':
             mode = FLOAT;
-            data.fptr = &state.r;
+            data.fptr = &word[GCODE_WORD_R];
             state.update_mask |= GCODE_UPDATE_R;
             break;
         case 'S':
             mode = FLOAT;
-            data.fptr = &state.s;
+            data.fptr = &word[GCODE_WORD_S];
             state.update_mask |= GCODE_UPDATE_S;
             break;
         case 'X':
             mode = FLOAT;
-            data.fptr = &state.axis[AXIS_X];
+            data.fptr = &word[GCODE_WORD_AXIS(AXIS_X)];
             state.update_mask |= GCODE_UPDATE_AXIS(AXIS_X);
             break;
         case 'Y':
             mode = FLOAT;
-            data.fptr = &state.axis[AXIS_Y];
+            data.fptr = &word[GCODE_WORD_AXIS(AXIS_Y)];
             state.update_mask |= GCODE_UPDATE_AXIS(AXIS_Y);
             break;
         case 'Z':
             mode = FLOAT;
-            data.fptr = &state.axis[AXIS_Z];
+            data.fptr = &word[GCODE_WORD_AXIS(AXIS_Z)];
             state.update_mask |= GCODE_UPDATE_AXIS(AXIS_Z);
             break;
         case 'E':
             mode = FLOAT;
-            data.fptr = &state.axis[AXIS_E];
+            data.fptr = &word[GCODE_WORD_AXIS(AXIS_E)];
             state.update_mask |= GCODE_UPDATE_AXIS(AXIS_E);
             break;
         case 'F':
             mode = FLOAT;
-            data.fptr = &state.f;
+            data.fptr = &word[GCODE_WORD_F];
             state.update_mask |= GCODE_UPDATE_F;
             break;
         default:
@@ -252,7 +264,7 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
         *data.fptr = neg * (float)ipart + ((float)fpart / (float)fbase);
         break;
     case STRING:
-        state.string[ipart] = 0;
+        _string[ipart] = 0;
         break;
     case INVALID:
         break;
@@ -286,6 +298,12 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
              state.cmd == 91 ||  /* G91 - Set relative mode */
              0 )) {
         state.buffered = true;
+    } else if (state.code == 'M' &&
+            (state.cmd == 116 || /* M116 - Wait for tool */
+             state.cmd == 640 || /* M640 - Layer cycle */
+             state.cmd == 641 || /* M641 - Arm tool */
+             0 )) {
+        state.buffered = true;
     } else if (state.code == 'T') {
         state.buffered = true;
     } else {
@@ -294,56 +312,55 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
 
     for (i = 0; i < AXIS_MAX; i++) {
         if (state.update_mask & GCODE_UPDATE_AXIS(i)) {
-            state.axis[i] *= _units_to_mm;
+            word[GCODE_WORD_AXIS(i)] *= _units_to_mm;
         }
     }
     if (state.update_mask & GCODE_UPDATE_F)
-        state.f *= _units_to_mm;
+        word[GCODE_WORD_F] *= _units_to_mm;
 
     if (state.update_mask & GCODE_UPDATE_STRING) {
-        if (state.string[0] == 0)
+        if (_string[0] == 0)
             state.update_mask &= ~GCODE_UPDATE_STRING;
+    } else {
+        _string[0] = 0;
+    }
+
+    /* Pack only the words that are present */
+    for (i = 0, n = 0; i < GCODE_WORD_MAX; i++) {
+        if (!(state.update_mask & (1 << i)))
+            continue;
+
+        if (n >= GCODE_VALUE_MAX) {
+            state.code = 0;
+            state.update_mask = GCODE_UPDATE_ERROR;
+            break;
+        }
+
+        state.value[n++] = word[i];
+    }
+
+    if (string_long) {
+        _string[0] = 0;
+        state.code = 0;
+        state.buffered = false;
+        state.update_mask = GCODE_UPDATE_ERROR | GCODE_UPDATE_STRING;
     }
 
     state.next = blk->next;
     *blk = state;
 
     if (_debug != &_null && blk->code) {
-        _debug->print("// ");
+        _debug->print(F("// "));
         _debug->print(blk->code);_debug->print(blk->cmd);
-        for (int i = 0; i < AXIS_MAX; i++) {
-            if (blk->update_mask & GCODE_UPDATE_AXIS(i)) {
+        for (int i = 0; i < GCODE_WORD_MAX; i++) {
+            if (blk->update_mask & (1 << i)) {
                 _debug->print(" ");
-                _debug->print("XYZE"[i]);
-                _debug->print(blk->axis[i]);
+                _debug->print("XYZEFIJKLPQRS"[i]);
+                _debug->print(gcode_value(blk, 1 << i));
             }
         }
-        if (blk->update_mask & GCODE_UPDATE_F) {
-            _debug->print(" F");_debug->print(blk->f);
-        }
-        if (blk->update_mask & GCODE_UPDATE_I) {
-            _debug->print(" I");_debug->print(blk->i);
-        }
-        if (blk->update_mask & GCODE_UPDATE_J) {
-            _debug->print(" J");_debug->print(blk->j);
-        }
-        if (blk->update_mask & GCODE_UPDATE_K) {
-            _debug->print(" K");_debug->print(blk->k);
-        }
-        if (blk->update_mask & GCODE_UPDATE_P) {
-            _debug->print(" P");_debug->print(blk->p);
-        }
-        if (blk->update_mask & GCODE_UPDATE_Q) {
-            _debug->print(" Q");_debug->print(blk->q);
-        }
-        if (blk->update_mask & GCODE_UPDATE_R) {
-            _debug->print(" R");_debug->print(blk->r);
-        }
-        if (blk->update_mask & GCODE_UPDATE_S) {
-            _debug->print(" S");_debug->print(blk->s);
-        }
         if (blk->update_mask & GCODE_UPDATE_STRING) {
-            _debug->print(" ");_debug->print(blk->string);
+            _debug->print(" ");_debug->print(_string);
         }
         _debug->println();
     }
@@ -356,13 +373,422 @@ bool GCode::_line_parse(struct gcode_line *line, struct gcode_block *blk)
 static void tool_parms(Tool *tool, const struct gcode_block *blk)
 {
         if (blk->update_mask & GCODE_UPDATE_P)
-            tool->parm_set(Tool::PARM_P, blk->p);
+            tool->parm_set(Tool::PARM_P, gcode_value(blk, GCODE_UPDATE_P));
         if (blk->update_mask & GCODE_UPDATE_Q)
-            tool->parm_set(Tool::PARM_Q, blk->q);
+            tool->parm_set(Tool::PARM_Q, gcode_value(blk, GCODE_UPDATE_Q));
         if (blk->update_mask & GCODE_UPDATE_R)
-            tool->parm_set(Tool::PARM_R, blk->r);
+            tool->parm_set(Tool::PARM_R, gcode_value(blk, GCODE_UPDATE_R));
         if (blk->update_mask & GCODE_UPDATE_S)
-            tool->parm_set(Tool::PARM_S, blk->s);
+            tool->parm_set(Tool::PARM_S, gcode_value(blk, GCODE_UPDATE_S));
+}
+
+void GCode::_feed_set(struct gcode_block *blk)
+{
+    if (blk->update_mask & GCODE_UPDATE_F) {
+        float rate = gcode_value(blk, GCODE_UPDATE_F) * _units_to_mm;
+        if (rate > 10.0)
+            _feed_rate = rate;
+    }
+}
+
+/* Preview a feed move to the current target */
+void GCode::_vis_feed(struct gcode_block *blk)
+{
+#if ENABLE_UI
+    if (_vis) {
+        float pos[AXIS_MAX];
+
+        _cnc->target_get(pos);
+
+        int color;
+        int tool = _cnc->toolhead()->selected();
+        /* Non-build tools are invisible.
+         * If we aren't extruding, use the tool color
+         */
+        if (tool < 1 || tool > 16)
+            color = VC_INVISIBLE;
+        else if (blk->update_mask & GCODE_UPDATE_AXIS(AXIS_E))
+            color = (blk->cmd == 0) ? VC_MOVE : VC_FEED;
+        else
+            color = VC_TOOL;
+
+        /* Brundlefab pattern render hack */
+        if (color == VC_TOOL) {
+            uint16_t pat = _cnc->tool()->parm_get(Tool::PARM_P);
+            int on = 0;
+            for (int i = 0; i < INK_NOZZLES; i++) {
+                if ((1 << i) & pat)
+                    on++;
+            }
+            if (on == 0)
+                color = VC_INVISIBLE;
+            else if (on < INK_NOZZLES)
+                color = VC_MOVE;
+
+            _vis->ink_to(pos, pat);
+        }
+
+        _vis->move_to(color, pos);
+    }
+#endif
+}
+
+/* Set up a G2/G3 arc in the XY plane, from the current target.
+ *
+ * The center is given by I and J (offsets from the start), or by
+ * the radius R (negative for the long way round). Z and E move
+ * linearly along the arc, for helices. The arc is split into the
+ * fewest equal chords whose sagitta is within ARC_CHORD_MM.
+ */
+void GCode::_arc_begin(struct gcode_block *blk, bool clockwise)
+{
+    float end[AXIS_MAX], axis[AXIS_MAX];
+    float rt[2], offset[2], angle, radius, theta_max;
+    int32_t segments;
+
+    _cnc->target_get(_arc.start);
+    gcode_axis(blk, axis);
+
+    for (int i = 0; i < AXIS_MAX; i++) {
+        end[i] = _arc.start[i];
+        if (blk->update_mask & GCODE_UPDATE_AXIS(i))
+            end[i] = (_positioning == ABSOLUTE) ? axis[i] : (end[i] + axis[i]);
+        _arc.delta[i] = end[i] - _arc.start[i];
+    }
+
+    if (blk->update_mask & GCODE_UPDATE_R) {
+        float r = gcode_value(blk, GCODE_UPDATE_R) * _units_to_mm;
+        float x = _arc.delta[AXIS_X];
+        float y = _arc.delta[AXIS_Y];
+        float d = x * x + y * y;
+        float h;
+
+        /* No unique center, so it's a straight line */
+        if (d == 0 || 4 * r * r < d) {
+            offset[0] = offset[1] = 0;
+        } else {
+            h = -sqrt(4 * r * r - d) / sqrt(d);
+            if (!clockwise)
+                h = -h;
+            if (r < 0)
+                h = -h;
+            offset[0] = (x - y * h) / 2;
+            offset[1] = (y + x * h) / 2;
+        }
+    } else {
+        offset[0] = gcode_value(blk, GCODE_UPDATE_I) * _units_to_mm;
+        offset[1] = gcode_value(blk, GCODE_UPDATE_J) * _units_to_mm;
+    }
+
+    _arc.center[0] = _arc.start[AXIS_X] + offset[0];
+    _arc.center[1] = _arc.start[AXIS_Y] + offset[1];
+    _arc.r0[0] = _arc.r[0] = -offset[0];
+    _arc.r0[1] = _arc.r[1] = -offset[1];
+    rt[0] = end[AXIS_X] - _arc.center[0];
+    rt[1] = end[AXIS_Y] - _arc.center[1];
+
+    radius = sqrt(_arc.r0[0] * _arc.r0[0] + _arc.r0[1] * _arc.r0[1]);
+
+    /* Counter-clockwise angle from start to end, then
+     * taken the right way round. Start == end is a full circle.
+     */
+    angle = atan2(_arc.r0[0] * rt[1] - _arc.r0[1] * rt[0],
+                  _arc.r0[0] * rt[0] + _arc.r0[1] * rt[1]);
+    if (clockwise && angle >= 0)
+        angle -= 2 * M_PI;
+    else if (!clockwise && angle <= 0)
+        angle += 2 * M_PI;
+
+    /* sagitta = r * (1 - cos(theta / 2)) */
+    if (radius <= ARC_CHORD_MM / 2)
+        segments = 1;
+    else {
+        theta_max = 2 * acos(1.0 - ARC_CHORD_MM / radius);
+        segments = ceil(fabs(angle) / theta_max);
+    }
+    if (segments < 1)
+        segments = 1;
+    if (segments > ARC_SEGMENTS_MAX)
+        segments = ARC_SEGMENTS_MAX;
+
+    _arc.axis_mask = (blk->update_mask & ((1 << AXIS_MAX) - 1)) |
+                     (1 << AXIS_X) | (1 << AXIS_Y);
+    _arc.segments = segments;
+    _arc.n = 0;
+    _arc.theta = angle / segments;
+    _arc.cos_t = cos(_arc.theta);
+    _arc.sin_t = sin(_arc.theta);
+
+    _arc_next();
+}
+
+/* Send the next chord of the arc. The chord end is found by
+ * rotating the radius vector, with an exact fix every
+ * ARC_CORRECTION chords to stop rounding error building up,
+ * and the last chord always ends exactly on the target.
+ */
+void GCode::_arc_next()
+{
+    float pos[AXIS_MAX], from[AXIS_MAX];
+    float frac;
+
+    _arc.n++;
+    _arc.segments--;
+
+    if (_arc.segments == 0) {
+        frac = 1.0;
+        _arc.r[0] = _arc.r0[0];
+        _arc.r[1] = _arc.r0[1];
+    } else {
+        frac = (float)_arc.n / (_arc.n + _arc.segments);
+        if ((_arc.n % ARC_CORRECTION) == 0) {
+            float c = cos(_arc.theta * _arc.n);
+            float s = sin(_arc.theta * _arc.n);
+
+            _arc.r[0] = _arc.r0[0] * c - _arc.r0[1] * s;
+            _arc.r[1] = _arc.r0[0] * s + _arc.r0[1] * c;
+        } else {
+            float x = _arc.r[0] * _arc.cos_t - _arc.r[1] * _arc.sin_t;
+
+            _arc.r[1] = _arc.r[0] * _arc.sin_t + _arc.r[1] * _arc.cos_t;
+            _arc.r[0] = x;
+        }
+    }
+
+    for (int i = 0; i < AXIS_MAX; i++)
+        pos[i] = _arc.start[i] + _arc.delta[i] * frac;
+
+    if (_arc.segments > 0) {
+        pos[AXIS_X] = _arc.center[0] + _arc.r[0];
+        pos[AXIS_Y] = _arc.center[1] + _arc.r[1];
+    }
+
+    _cnc->target_get(from);
+    _cnc->target_set_rate(pos, _arc.axis_mask, _feed_rate);
+    _ink_track(from, pos);
+
+    if (_block.active)
+        _vis_feed(_block.active);
+}
+
+/* Nozzles on for ink tool 'id', or -1 if it is neither
+ * selected nor armed (printing alongside the selected one)
+ */
+int GCode::_ink_pattern(int id)
+{
+    ToolHead *th = _cnc->toolhead();
+    Tool *tool = th->tool(id);
+
+    if (id < 1 || id > 16 || !tool)
+        return -1;
+
+    if (id != th->selected() && !th->armed(id))
+        return -1;
+
+    return (uint16_t)tool->parm_get(Tool::PARM_P) &
+           ((1 << INK_NOZZLES) - 1);
+}
+
+/* Nozzles on across all the ink tools in use, or -1 if none are */
+int GCode::_ink_nozzles()
+{
+    int pat = -1;
+
+    for (int id = 1; id <= 16; id++) {
+        int head = _ink_pattern(id);
+
+        if (head >= 0)
+            pat = (pat < 0) ? head : (pat | head);
+    }
+
+    return pat;
+}
+
+/* Grow the layer's inked extents by a move from 'from' to 'to',
+ * for each ink tool in use with any nozzles on. The nozzles
+ * spread along X from the head position, and the heads sit
+ * apart on X by their tool offsets.
+ */
+void GCode::_ink_track(const float *from, const float *to)
+{
+    const float *offset = _cnc->tool()->offset_is();
+
+    for (int id = 1; id <= 16; id++) {
+        int pat = _ink_pattern(id);
+        int first, last;
+        float lo[2], hi[2], shift;
+
+        if (pat <= 0)
+            continue;
+
+        for (first = 0; !(pat & (1 << first)); first++);
+        for (last = INK_NOZZLES - 1; !(pat & (1 << last)); last--);
+
+        for (int i = 0; i < 2; i++) {
+            lo[i] = (from[i] < to[i]) ? from[i] : to[i];
+            hi[i] = (from[i] < to[i]) ? to[i] : from[i];
+        }
+        shift = _cnc->tool(id)->offset_is()[AXIS_X] - offset[AXIS_X];
+        lo[AXIS_X] += shift + first * INK_NOZZLE_MM;
+        hi[AXIS_X] += shift + last * INK_NOZZLE_MM;
+
+        for (int i = 0; i < 2; i++) {
+            if (!_ink.valid || lo[i] < _ink.min[i])
+                _ink.min[i] = lo[i];
+            if (!_ink.valid || hi[i] > _ink.max[i])
+                _ink.max[i] = hi[i];
+        }
+        _ink.valid = true;
+    }
+}
+
+/* Switch tools in the middle of a layer cycle */
+void GCode::_layer_tool(int tool_id)
+{
+    ToolHead *th = _cnc->toolhead();
+
+    if (th->selected() == tool_id)
+        return;
+
+    if (!th->armed())
+        th->tool()->stop();
+    th->select(tool_id);
+    th->tool()->start();
+}
+
+/* Start an M640 layer cycle, updating the settings from the block:
+ *
+ *   Z - layer height (mm)
+ *   K - powder feed ratio (E raise / Z drop)
+ *   F - recoat feed rate (mm/minute)
+ *   S - fuse pass time (ms), 0 to skip fusing
+ *   I - X travel start (feed side, mm)
+ *   J - X travel end (past the part bin, mm), J > I
+ *   L - margin (mm) around the inked X extents, or -1
+ *
+ * The cycle fuses the layer that has just been inked, then lays
+ * down powder for the next one, leaving the head at the end of
+ * the recoat pass with the null tool selected.
+ *
+ * With a margin of 0 or more, the fuse pass and the end of the
+ * recoat pass are clipped to the layer's inked X extents plus
+ * the margin. A layer with no ink is not fused at all.
+ */
+void GCode::_layer_begin(struct gcode_block *blk)
+{
+    if (blk->update_mask & GCODE_UPDATE_AXIS(AXIS_Z))
+        _layer.height = gcode_value(blk, GCODE_UPDATE_AXIS(AXIS_Z));
+    if (blk->update_mask & GCODE_UPDATE_K)
+        _layer.ratio = gcode_value(blk, GCODE_UPDATE_K);
+    if (blk->update_mask & GCODE_UPDATE_F) {
+        float rate = gcode_value(blk, GCODE_UPDATE_F);
+        if (rate > 10.0)
+            _layer.recoat_rate = rate;
+    }
+    if (blk->update_mask & GCODE_UPDATE_S)
+        _layer.dwell = gcode_value(blk, GCODE_UPDATE_S);
+    if (blk->update_mask & GCODE_UPDATE_I)
+        _layer.x_start = gcode_value(blk, GCODE_UPDATE_I) * _units_to_mm;
+    if (blk->update_mask & GCODE_UPDATE_J)
+        _layer.x_end = gcode_value(blk, GCODE_UPDATE_J) * _units_to_mm;
+    if (blk->update_mask & GCODE_UPDATE_L)
+        _layer.margin = gcode_value(blk, GCODE_UPDATE_L) * _units_to_mm;
+
+    _layer.phase = _layer.LAYER_SEEK;
+    _layer_next();
+}
+
+/* The X span the fuse and recoat passes have to cover. Returns
+ * false if, going by the ink extents, there is nothing to fuse.
+ */
+bool GCode::_layer_span(float *lo, float *hi)
+{
+    *lo = _layer.x_start;
+    *hi = _layer.x_end;
+
+    if (_layer.margin < 0)
+        return true;
+
+    if (!_ink.valid)
+        return false;
+
+    if (_ink.min[0] - _layer.margin > *lo)
+        *lo = _ink.min[0] - _layer.margin;
+    if (_ink.max[0] + _layer.margin < *hi)
+        *hi = _ink.max[0] + _layer.margin;
+
+    return *lo < *hi;
+}
+
+/* Run the next phase of the layer cycle. Each phase is a single
+ * move, started as soon as the previous one is done, with no
+ * round trip to the host in between. Z drops on the way to the
+ * first pass, since nothing is touching the bed then. E raises
+ * on the move that brings the head back to the start of travel,
+ * so the powder is fed just as the recoat pass is about to begin.
+ */
+void GCode::_layer_next()
+{
+    float pos[AXIS_MAX];
+    float lo, hi;
+    bool inked = _layer_span(&lo, &hi);
+    bool fuse = _layer.dwell > 0 && _layer.x_end != _layer.x_start && inked;
+
+    _cnc->target_get(pos);
+
+    switch (_layer.phase) {
+    case _layer.LAYER_SEEK:
+        _layer_tool(TOOL_NONE);
+        /* Pre-heat the fuser while the head is on its way */
+        _layer.armed = _cnc->toolhead()->armed(TOOL_FUSER);
+        if (fuse)
+            _cnc->toolhead()->arm(TOOL_FUSER);
+        pos[AXIS_Z] += _layer.height;
+        if (fuse) {
+            pos[AXIS_X] = hi;
+            _cnc->target_set_rate(pos, (1 << AXIS_X) | (1 << AXIS_Z), _feed_rate);
+            _layer.phase = _layer.LAYER_FUSE;
+        } else {
+            pos[AXIS_X] = _layer.x_start;
+            pos[AXIS_E] += _layer.height * _layer.ratio;
+            _cnc->target_set_rate(pos, (1 << AXIS_X) | (1 << AXIS_Z) | (1 << AXIS_E), _feed_rate);
+            _layer.phase = _layer.LAYER_RECOAT;
+        }
+        break;
+    case _layer.LAYER_FUSE:
+        /* Wait here, at the start of the pass, for the fuser */
+        if (_cnc->tool(TOOL_FUSER) && !_cnc->tool(TOOL_FUSER)->ready())
+            break;
+        _layer_tool(TOOL_FUSER);
+        /* Same speed as a full pass, however much of it is clipped */
+        pos[AXIS_X] = lo;
+        _cnc->target_set_rate(pos, (1 << AXIS_X),
+                fabs(_layer.x_end - _layer.x_start) * 60000.0 / _layer.dwell);
+        _layer.phase = _layer.LAYER_RETURN;
+        break;
+    case _layer.LAYER_RETURN:
+        _layer_tool(TOOL_NONE);
+        if (!_layer.armed)
+            _cnc->toolhead()->arm(TOOL_FUSER, false);
+        pos[AXIS_X] = _layer.x_start;
+        pos[AXIS_E] += _layer.height * _layer.ratio;
+        _cnc->target_set_rate(pos, (1 << AXIS_X) | (1 << AXIS_E), _feed_rate);
+        _layer.phase = _layer.LAYER_RECOAT;
+        break;
+    case _layer.LAYER_RECOAT:
+        _layer_tool(TOOL_RECOAT);
+        pos[AXIS_X] = inked ? hi : _layer.x_end;
+        _cnc->target_set_rate(pos, (1 << AXIS_X), _layer.recoat_rate);
+        _layer.phase = _layer.LAYER_DONE;
+        break;
+    case _layer.LAYER_DONE:
+        _layer_tool(TOOL_NONE);
+        _ink.valid = false;
+        _layer.phase = _layer.LAYER_IDLE;
+        break;
+    case _layer.LAYER_IDLE:
+        break;
+    }
 }
 
 void GCode::_block_do(struct gcode_block *blk)
@@ -370,12 +796,16 @@ void GCode::_block_do(struct gcode_block *blk)
     Stream *out = blk->io->out;
     ToolHead *th;
     bool tool_change;
+    float axis[AXIS_MAX];
+    size_t size;
 #if ENABLE_SD
     File tmp_file, *program;
 
     program = _cnc->program();
 #endif
 
+    _stats.blocks++;
+
     switch (blk->code) {
     case 'T':
         th = _cnc->toolhead();
@@ -383,7 +813,8 @@ void GCode::_block_do(struct gcode_block *blk)
         tool_change = th->selected() != blk->cmd;
 
         if (tool_change) {
-            th->tool()->stop();
+            if (!th->armed())
+                th->tool()->stop();
             th->select(blk->cmd);
         }
 
@@ -396,12 +827,13 @@ void GCode::_block_do(struct gcode_block *blk)
     case 'G':
         switch (blk->cmd) {
         case 0: /* G0 - Uncontrolled move */
+            gcode_axis(blk, axis);
             switch (_positioning) {
             case ABSOLUTE:
-                _cnc->target_set(blk->axis, blk->update_mask);
+                _cnc->target_set(axis, blk->update_mask);
                 break;
             case RELATIVE:
-                _cnc->target_move(blk->axis, blk->update_mask);
+                _cnc->target_move(axis, blk->update_mask);
                 break;
             }
 
@@ -410,80 +842,63 @@ void GCode::_block_do(struct gcode_block *blk)
                 float pos[AXIS_MAX];
 
                 _cnc->target_get(pos);
-                _vis->cursor_to(pos);
+                _vis->move_to(VC_INVISIBLE, pos);
             }
 #endif
 
             break;
         case 1: /* G1 - Controlled move */
-            if (blk->update_mask & GCODE_UPDATE_F) {
-                float rate = blk->f * _units_to_mm;
-                if (rate > 10.0)
-                    _feed_rate = rate;
-            }
-
-            switch (_positioning) {
-            case ABSOLUTE:
-                _cnc->target_set_rate(blk->axis, blk->update_mask, _feed_rate);
-                break;
-            case RELATIVE:
-                _cnc->target_move_rate(blk->axis, blk->update_mask, _feed_rate);
-                break;
-            }
-
-#if ENABLE_UI
-            if (_vis) {
-                float pos[AXIS_MAX];
-
-                _cnc->target_get(pos);
+            _feed_set(blk);
 
-                int color;
-                int tool = _cnc->toolhead()->selected();
-                /* Non-build tools are invisible.
-                 * If we aren't extruding, use the tool color
+            {
+                float from[AXIS_MAX], to[AXIS_MAX];
+                uint16_t z_e = GCODE_UPDATE_AXIS(AXIS_Z) |
+                               GCODE_UPDATE_AXIS(AXIS_E);
+                /* An X/Y move with the ink tool's nozzles all off
+                 * is just positioning, so make it at travel speed.
                  */
-                if (tool < 1 || tool > 16)
-                    color = VC_INVISIBLE;
-                else if (blk->update_mask & GCODE_UPDATE_AXIS(AXIS_E))
-                    color = (blk->cmd == 0) ? VC_MOVE : VC_FEED;
-                else
-                    color = VC_TOOL;
-
-                /* Brundlefab pattern render hack */
-                if (color == VC_TOOL) {
-                    uint16_t pat = _cnc->tool()->parm_get(Tool::PARM_P);
-                    int on = 0;
-                    for (int i = 0; i < 12; i++) {
-                        if ((1 << i) & pat)
-                            on++;
-                    }
-                    if (on == 0)
-                        color = VC_INVISIBLE;
-                    else if (on < 12)
-                        color = VC_MOVE;
+                bool rapid = _ink_nozzles() == 0 && !(blk->update_mask & z_e);
+
+                _cnc->target_get(from);
+
+                gcode_axis(blk, axis);
+                switch (_positioning) {
+                case ABSOLUTE:
+                    if (rapid)
+                        _cnc->target_set(axis, blk->update_mask);
+                    else
+                        _cnc->target_set_rate(axis, blk->update_mask, _feed_rate);
+                    break;
+                case RELATIVE:
+                    if (rapid)
+                        _cnc->target_move(axis, blk->update_mask);
+                    else
+                        _cnc->target_move_rate(axis, blk->update_mask, _feed_rate);
+                    break;
                 }
 
-                if (color == VC_INVISIBLE) {
-                    _vis->cursor_to(pos);
-                } else {
-                    _vis->line_to(color, pos);
-                }
+                _cnc->target_get(to);
+                _ink_track(from, to);
             }
-#endif
+
+            _vis_feed(blk);
+            break;
+        case 2: /* G2 - Clockwise arc */
+        case 3: /* G3 - Counter-clockwise arc */
+            _feed_set(blk);
+            _arc_begin(blk, blk->cmd == 2);
             break;
         case 10: /* G10 - Tool parameters */
             if (blk->update_mask & GCODE_UPDATE_L) {
-                switch ((int)blk->l) {
+                switch ((int)gcode_value(blk, GCODE_UPDATE_L)) {
                     case 1: /* G10 L1 - Set tool table entry */
                         if (blk->update_mask & GCODE_UPDATE_P) {
-                            float pos[AXIS_MAX] = {};
-                            for (int i = 0; i < AXIS_MAX; i++) {
-                                if (blk->update_mask & GCODE_UPDATE_AXIS(i))
-                                    pos[i] = blk->axis[i];
-                                _cnc->tool_offset_set((int)blk->p, pos, blk->update_mask);
-                            }
-
-                            tool_parms(_cnc->tool((int)blk->p), blk);
+                            int tool = (int)gcode_value(blk, GCODE_UPDATE_P);
+
+                            gcode_axis(blk, axis);
+                            _cnc->tool_offset_set(tool, axis, blk->update_mask);
+
+                            tool_parms(_cnc->tool(tool), blk);
                         }
                         break;
                     default:
@@ -498,14 +913,23 @@ void GCode::_block_do(struct gcode_block *blk)
             _units_to_mm = 1.0;
             break;
         case 28: /* G28 - Re-home */
-            _cnc->home(blk->update_mask);
-            _cnc->target_set(blk->axis, blk->update_mask);
+            {
+                uint8_t axis_mask = blk->update_mask & ((1 << AXIS_MAX) - 1);
+
+                /* No axes given? Home them all, together. */
+                if (!axis_mask)
+                    axis_mask = (1 << AXIS_MAX) - 1;
+
+                gcode_axis(blk, axis);
+                _cnc->home(axis_mask);
+                _cnc->target_set(axis, axis_mask);
+            }
 #if ENABLE_UI
             if (_vis) {
                 float pos[AXIS_MAX];
 
                 _cnc->target_get(pos);
-                _vis->cursor_to(pos);
+                _vis->move_to(VC_INVISIBLE, pos);
             }
 #endif
             break;
@@ -522,7 +946,7 @@ void GCode::_block_do(struct gcode_block *blk)
                 _cnc->position_get(pos);
                 for (int i = 0; i < AXIS_MAX; i++) {
                     if (blk->update_mask & GCODE_UPDATE_AXIS(i))
-                        _offset[i] = pos[i] + blk->axis[i];
+                        _offset[i] = pos[i] + gcode_value(blk, GCODE_UPDATE_AXIS(i));
                 }
             }
         default:
@@ -545,9 +969,9 @@ void GCode::_block_do(struct gcode_block *blk)
             break;
 #if ENABLE_SD
         case 20: /* M20 - List SD files */
-            out->print(" Files: {");
+            out->print(F(" Files: {"));
             if (blk->update_mask & GCODE_UPDATE_STRING)
-                tmp_file = SD.open(blk->string);
+                tmp_file = SD.open(_string);
             else
                 tmp_file = SD.open("/");
             if (tmp_file) {
@@ -564,10 +988,10 @@ void GCode::_block_do(struct gcode_block *blk)
                     out->print(",");
                 }
             }
-            out->print("}");
+            out->print(F("}"));
             break;
         case 23: /* M23 - Select SD file */
-            file_select(blk->string, true);
+            file_select(_string, true);
             break;
         case 24: /* M24 - Start SD print */
             file_start();
@@ -577,45 +1001,45 @@ void GCode::_block_do(struct gcode_block *blk)
             break;
         case 26: /* M26 - Set SD position */
             if (*program)
-                program->seek((uint32_t)blk->s);
+                program->seek((uint32_t)gcode_value(blk, GCODE_UPDATE_S));
             break;
         case 27: /* M27 - Show SD position */
             if (*program) {
-                out->print(" SD printing byte ");
+                out->print(F(" SD printing byte "));
                 out->print(program->position());
                 out->print("/");
                 out->print(program->size());
             } else {
-                out->print(" Not SD printing");
+                out->print(F(" Not SD printing"));
             }
             break;
         case 30: /* M30 - Delete file from SD */
-            SD.remove(blk->string);
+            SD.remove(_string);
             break;
         case 32: /* M32 - Select SD file, and print */
-            file_select(blk->string, true);
+            file_select(_string, true);
             break;
         case 36: /* M36 - Return file information */
-            tmp_file = SD.open(blk->string);
-            out->print(" {\"err\":");
+            tmp_file = SD.open(_string);
+            out->print(F(" {\"err\":"));
             if (tmp_file) {
-                out->print("0,\"size\":");
+                out->print(F("0,\"size\":"));
                 out->print(tmp_file.size());
-                out->print("}");
+                out->print(F("}"));
                 tmp_file.close();
             } else {
-                out->print("1}");
+                out->print(F("1}"));
             }
             break;
 #endif /* ENABLE_SD */
         case 105: /* M105 - Report Bed and Tool temperature */
-            out->print(" T:");
+            out->print(F(" T:"));
             out->print(_cnc->tool(1)->celsius());
-            out->print(" B:-273");
+            out->print(F(" B:-273"));
             break;
         case 111: /* M111 - Set debug */
             if (blk->update_mask & GCODE_UPDATE_S) {
-                int s = (int)blk->s;
+                int s = (int)gcode_value(blk, GCODE_UPDATE_S);
                 if (s & DEBUG_ECHO)
                     _debug = out;
                 else
@@ -630,26 +1054,28 @@ void GCode::_block_do(struct gcode_block *blk)
                 for (int i = 0; i < AXIS_MAX; i++)
                     pos[i] /= _units_to_mm;
 
-                out->print(" C: X:"); out->print(pos[AXIS_X]);
-                out->print(" Y:"); out->print(pos[AXIS_Y]);
-                out->print(" Z:"); out->print(pos[AXIS_Z]);
-                out->print(" E:"); out->print(pos[AXIS_E]);
+                out->print(F(" C: X:")); out->print(pos[AXIS_X]);
+                out->print(F(" Y:")); out->print(pos[AXIS_Y]);
+                out->print(F(" Z:")); out->print(pos[AXIS_Z]);
+                out->print(F(" E:")); out->print(pos[AXIS_E]);
             }
             break;
         case 115: /* M115 - Get firmware version */
-            out->print(" FIRMWARE_NAME:BrundleFab");
+            out->print(F(" FIRMWARE_NAME:BrundleFab"));
             break;
         case 116: /* M116 - Wait for tool temp */
-            if (blk->update_mask & GCODE_UPDATE_P) {
-                int tool = (int)blk->p;
-                while (!_cnc->tool(tool)->ready());
-            } else {
-                while (!_cnc->tool()->ready());
-            }
+            /* The block is held active by update() until the tool
+             * is ready, so motion and serial I/O carry on.
+             */
+            if (blk->update_mask & GCODE_UPDATE_P)
+                _wait_tool = _cnc->tool((int)gcode_value(blk, GCODE_UPDATE_P));
+            else
+                _wait_tool = _cnc->tool();
+            break;
         case 117: /* M117 - Display string */
             out->print(" ");
-            out->print(blk->string);
-            _cnc->status_set(blk->string);
+            out->print(_string);
+            _cnc->status_set(_string);
             break;
         case 119: /* M119 - Report endstop status */
             for (int i = 0; i < AXIS_MAX; i++) {
@@ -657,18 +1083,79 @@ void GCode::_block_do(struct gcode_block *blk)
                 state = _cnc->axis_endstop(i, Axis::STOP_MIN, &exists);
                 if (exists) {
                     out->print(" ");out->print("xyze"[i]);
-                    out->print("_min:");out->print(state ? "TRIGGERED" : "open");
+                    out->print(F("_min:"));out->print(state ? F("TRIGGERED") : F("open"));
                 }
                 state = _cnc->axis_endstop(i, Axis::STOP_MAX, &exists);
                 if (exists) {
                     out->print(" ");out->print("xyze"[i]);
-                    out->print("_max:");out->print(state ? "TRIGGERED" : "open");
+                    out->print(F("_max:"));out->print(state ? F("TRIGGERED") : F("open"));
                 }
             }
             break;
+        case 122: /* M122 - Report memory and queue usage */
+            size = memory_free();
+            out->print(F(" free:"));
+            if (size == MEMORY_UNKNOWN)
+                out->print(F("n/a"));
+            else
+                out->print(size);
+            size = memory_stack_unused();
+            out->print(F(" stack:"));
+            if (size == MEMORY_UNKNOWN)
+                out->print(F("n/a"));
+            else
+                out->print(size);
+            out->print(F(" queue:")); out->print(queue_used());
+            out->print("/"); out->print(GCODE_QUEUE_MAX);
+            out->print(F(" lines:")); out->print(_stats.lines);
+            out->print(F(" blocks:")); out->print(_stats.blocks);
+            out->print(F(" starved:")); out->print(_stats.starved);
+            break;
         case 124: /* M124 - Immediate motor stop */
             _cnc->stop();
+            _arc.segments = 0;
+            _layer.phase = _layer.LAYER_IDLE;
+            _wait_tool = NULL;
+            break;
+#if ENABLE_TRACE
+        case 470: /* M470 - Dump step trace, to serial or an SD file */
+            out->print(F(" trace:")); out->print(trace_recorded());
+#if ENABLE_SD
+            if (blk->update_mask & GCODE_UPDATE_STRING) {
+                SD.remove(_string);
+                tmp_file = SD.open(_string, FILE_WRITE);
+                if (tmp_file) {
+                    trace_dump(&tmp_file);
+                    tmp_file.println();
+                    tmp_file.close();
+                } else {
+                    out->print(F(" !! can't open"));
+                }
+                break;
+            }
+#endif
+            trace_dump(out);
+            break;
+        case 471: /* M471 - Clear step trace */
+            trace_clear();
+            break;
+#endif
+#if ENABLE_PROFILE
+        case 472: /* M472 - Report loop profile, S1 to also reset it */
+            profile_report(out);
+            if (blk->update_mask & GCODE_UPDATE_S) {
+                if ((int)gcode_value(blk, GCODE_UPDATE_S))
+                    profile_reset();
+            }
+            break;
+#endif
+#if ENABLE_UI
+        case 480: /* M480 - Select preview mode */
+            if (_vis && (blk->update_mask & GCODE_UPDATE_S))
+                _vis->mode_set((int)gcode_value(blk, GCODE_UPDATE_S) ?
+                               VIS_MODE_COVERAGE : VIS_MODE_WIREFRAME);
             break;
+#endif
         case 490: /* M490 - Send message to serial bus 0 */
         case 491: /* M491 - Send message to serial bus 1 */
         case 492: /* M492 - Send message to serial bus 2 */
@@ -676,7 +1163,7 @@ void GCode::_block_do(struct gcode_block *blk)
             Stream *s;
             s = _cnc->serial_get(blk->cmd - 490);
             if (s) {
-                s->write(blk->string);
+                s->write(_string);
                 out->print(' ');
                 while (s->available()) {
                     char c = s->read();
@@ -688,6 +1175,32 @@ void GCode::_block_do(struct gcode_block *blk)
                 }
             }
             break;
+        case 640: /* M640 - Layer cycle: fuse, feed and recoat */
+            _layer_begin(blk);
+            break;
+        case 642: /* M642 - Report the layer's inked extents */
+            if (_ink.valid) {
+                out->print(F(" ink: X:")); out->print(_ink.min[AXIS_X]);
+                out->print(F("..")); out->print(_ink.max[AXIS_X]);
+                out->print(F(" Y:")); out->print(_ink.min[AXIS_Y]);
+                out->print(F("..")); out->print(_ink.max[AXIS_Y]);
+            } else {
+                out->print(F(" ink: none"));
+            }
+            if ((blk->update_mask & GCODE_UPDATE_S) &&
+                gcode_value(blk, GCODE_UPDATE_S) != 0)
+                _ink.valid = false;
+            break;
+        case 641: /* M641 - Arm (pre-heat) a tool in the background */
+            if (blk->update_mask & GCODE_UPDATE_P) {
+                bool armed = true;
+
+                if (blk->update_mask & GCODE_UPDATE_S)
+                    armed = gcode_value(blk, GCODE_UPDATE_S) != 0;
+
+                _cnc->toolhead()->arm((int)gcode_value(blk, GCODE_UPDATE_P), armed);
+            }
+            break;
         default:
             break;
         }
@@ -697,11 +1210,73 @@ void GCode::_block_do(struct gcode_block *blk)
     }
 }
 
+/* An axis that lost its position holds the queue, and pauses
+ * the SD program, until M17 or Cycle Start resumes it.
+ */
+bool GCode::_fault_hold()
+{
+    uint8_t axes = _cnc->axis_fault();
+
+    if (axes && _cnc->button_get(CNC_BUTTON_CYCLE_START)) {
+        _cnc->axis_enable(axes);
+        axes = _cnc->axis_fault();
+    }
+
+    if (axes == _fault.axes)
+        return axes != 0;
+
+    if (axes) {
+        _console.out->print(F("!! fault"));
+        for (int i = 0; i < AXIS_MAX; i++) {
+            if (axes & (1 << i)) {
+                _console.out->print(" ");
+                _console.out->print("xyze"[i]);
+            }
+        }
+        _console.out->println(F(", M17 to resume"));
+        _cnc->message_set("Axis fault");
+#if ENABLE_SD
+        if (_enabled(&_program)) {
+            _pause(&_program);
+            _fault.paused = true;
+        }
+#endif
+    } else {
+        _cnc->message_set(NULL);
+#if ENABLE_SD
+        if (_fault.paused)
+            _start(&_program);
+#endif
+        _fault.paused = false;
+    }
+
+    _fault.axes = axes;
+    return axes != 0;
+}
+
 void GCode::update(bool cnc_active)
 {
-    /* If the axes are idle, then the current active block is done */
-    if (!cnc_active) {
+    /* If the axes are idle, then the current active block is done,
+     * unless it is held by an axis fault, an arc with chords still
+     * to send, a layer cycle part way through, or a wait for a tool.
+     */
+    if (!cnc_active && _fault_hold()) {
+        /* Held */
+    } else if (!cnc_active && _arc.segments > 0) {
+        _arc_next();
+    } else if (!cnc_active && _layer.phase != _layer.LAYER_IDLE) {
+        _layer_next();
+    } else if (!cnc_active && _wait_tool) {
+        if (_wait_tool->ready())
+            _wait_tool = NULL;
+    } else if (!cnc_active) {
         if (_block.active) {
+            struct gcode_io *io = _block.active->io;
+
+            /* Nothing queued behind it, but the next line is on its way */
+            if (!_block.pending && (io->line.len > 0 || io->in->available()))
+                _stats.starved++;
+
             _block.active->next = _block.free;
             _block.free = _block.active;
             _block.active = NULL;
@@ -717,16 +1292,23 @@ void GCode::update(bool cnc_active)
     }
 
     /* Serial input is of higher priority than SD input */
+    PROFILE_START(PROFILE_SERIAL);
     _process_io(&_console);
+    PROFILE_STOP(PROFILE_SERIAL);
 
 #if ENABLE_SD
+    PROFILE_START(PROFILE_SD);
     _process_io(&_program);
+    PROFILE_STOP(PROFILE_SD);
 #endif
 }
 
 void GCode::_process_io(struct gcode_io *io)
 {
-    struct gcode_block *blk;
+    struct gcode_block scratch, *blk;
+    uint8_t len;
+
+    scratch.next = NULL;
 
     /* If paused, wait for the Cycle Start button to be pressed
      */
@@ -738,16 +1320,35 @@ void GCode::_process_io(struct gcode_io *io)
         }
     }
 
-    blk = _block.free;
-
-    if (!blk)
-        return;
+    /* Queue a held block as soon as there is room */
+    if (io->held && _halted) {
+        io->held = false;
+        io->out->println("!!");
+    } else if (io->held && _block.free) {
+        struct gcode_block *next = _block.free->next;
+
+        blk = _block.free;
+        *blk = io->hold;
+        blk->next = next;
+        io->held = false;
+
+        io->out->print(F("ok"));
+        _process_block(blk);
+        io->out->println();
+    }
 
-    if (io->in->available()) {
+    if (io->waiting) {
+        if (io->held)
+            return;
+        io->waiting = false;
+    } else {
         char c;
 
+        if (!io->in->available())
+            return;
+
         if (io->line.len == 0)
-            _debug->print("// ");
+            _debug->print(F("// "));
 
         c = io->in->read();
 
@@ -756,24 +1357,58 @@ void GCode::_process_io(struct gcode_io *io)
         else
             _debug->print(c);
 
-        if (_line_update(&io->line, c)) {
-            if (_halted) {
-                io->out->println("!!");
-            } else if (_line_parse(&io->line, blk)) {
-                io->out->print("ok");
+        if (!_line_update(&io->line, c))
+            return;
 
-                blk->io = io;
+        if (io->line.len > 0)
+            _stats.lines++;
+    }
 
-                _process_block(blk);
+    if (_halted) {
+        io->out->println("!!");
+        _line_reset(&io->line);
+        return;
+    }
 
-                io->out->println();
+    /* With the queue full, lines are parsed into a scratch block,
+     * so unbuffered commands - M17 after a fault, M112, reports -
+     * still get through.
+     */
+    blk = _block.free ? _block.free : &scratch;
+    len = io->line.len;
+
+    if (_line_parse(&io->line, blk)) {
+        blk->io = io;
+
+        if (blk == &scratch && blk->buffered &&
+            !(blk->update_mask & GCODE_UPDATE_ERROR)) {
+            if (io->held) {
+                /* Parse it again once the held block is queued */
+                io->line.len = len;
+                io->waiting = true;
             } else {
-
-                io->out->print("rs");
-
-                io->out->println(blk->num);
+                io->hold = scratch;
+                io->held = true;
             }
+            return;
         }
+
+        io->out->print(F("ok"));
+
+        if (blk->update_mask & GCODE_UPDATE_STRING &&
+            blk->update_mask & GCODE_UPDATE_ERROR)
+            io->out->print(F(" !! string too long"));
+        else if (blk->update_mask & GCODE_UPDATE_ERROR)
+            io->out->print(F(" !! too many words"));
+        else
+            _process_block(blk);
+
+        io->out->println();
+    } else {
+
+        io->out->print(F("rs"));
+
+        io->out->println(blk->num);
     }
 }
 
@@ -782,7 +1417,25 @@ void GCode::_process_block(struct gcode_block *blk)
     /* Special case: M112 Emergency stop */
     if (blk->code == 'M' && blk->cmd == 112) {
         _cnc->stop();
+        _arc.segments = 0;
+        _layer.phase = _layer.LAYER_IDLE;
+        _wait_tool = NULL;
         _halted = true;
+
+        /* Nothing queued runs after an emergency stop */
+        if (_block.active) {
+            _block.active->next = _block.free;
+            _block.free = _block.active;
+            _block.active = NULL;
+        }
+        while (_block.pending) {
+            struct gcode_block *next = _block.pending->next;
+
+            _block.pending->next = _block.free;
+            _block.free = _block.pending;
+            _block.pending = next;
+        }
+        _block.pending_tail = &_block.pending;
         return;
     }
 
@@ -20,11 +20,6 @@
 
 #include "config.h"
 
-#include <limits.h>
-#ifndef PATH_MAX
-#define PATH_MAX        256
-#endif
-
 #include <Stream.h>
 #include <SD.h>
 
@@ -38,35 +33,54 @@
 
 #define GCODE_LINE_MAX  255
 #define GCODE_QUEUE_MAX 4
+#define GCODE_VALUE_MAX 8       /* Maximum words per block */
+#define GCODE_STRING_MAX 80     /* M20, M23, M30, M32, M36, M117, M470, M49x */
 
 struct gcode_line {
     uint8_t len;
     char buff[GCODE_LINE_MAX];
 };
 
-struct gcode_io {
-    bool enable;
-    struct gcode_line line;
-    Stream *in, *out;
-};
-
-struct gcode_parameter {
-    char label;
-    float value;
+/* Throughput counters, reported by M122 */
+struct gcode_stats {
+    unsigned long lines;        /* Lines parsed */
+    unsigned long blocks;       /* Blocks executed */
+    unsigned long starved;      /* Motion went idle while a line was arriving */
 };
 
-#define GCODE_UPDATE_AXIS(x)    (1 << (x))
-#define GCODE_UPDATE_F          (1 << (AXIS_MAX + 0))
-#define GCODE_UPDATE_I          (1 << (AXIS_MAX + 1))
-#define GCODE_UPDATE_J          (1 << (AXIS_MAX + 2))
-#define GCODE_UPDATE_K          (1 << (AXIS_MAX + 3))
-#define GCODE_UPDATE_L          (1 << (AXIS_MAX + 4))
-#define GCODE_UPDATE_P          (1 << (AXIS_MAX + 5))
-#define GCODE_UPDATE_Q          (1 << (AXIS_MAX + 6))
-#define GCODE_UPDATE_R          (1 << (AXIS_MAX + 7))
-#define GCODE_UPDATE_S          (1 << (AXIS_MAX + 8))
-#define GCODE_UPDATE_STRING     (1 << (AXIS_MAX + 9))
-
+#define GCODE_WORD_AXIS(x)      (x)
+#define GCODE_WORD_F            (AXIS_MAX + 0)  /* feed rate */
+#define GCODE_WORD_I            (AXIS_MAX + 1)  /* x center of arc */
+#define GCODE_WORD_J            (AXIS_MAX + 2)  /* y center of arc */
+#define GCODE_WORD_K            (AXIS_MAX + 3)  /* z center of arc */
+#define GCODE_WORD_L            (AXIS_MAX + 4)  /* parameter */
+#define GCODE_WORD_P            (AXIS_MAX + 5)  /* parameter */
+#define GCODE_WORD_Q            (AXIS_MAX + 6)  /* parameter */
+#define GCODE_WORD_R            (AXIS_MAX + 7)  /* parameter */
+#define GCODE_WORD_S            (AXIS_MAX + 8)  /* parameter */
+#define GCODE_WORD_MAX          (AXIS_MAX + 9)
+
+#define GCODE_UPDATE_AXIS(x)    (1 << GCODE_WORD_AXIS(x))
+#define GCODE_UPDATE_F          (1 << GCODE_WORD_F)
+#define GCODE_UPDATE_I          (1 << GCODE_WORD_I)
+#define GCODE_UPDATE_J          (1 << GCODE_WORD_J)
+#define GCODE_UPDATE_K          (1 << GCODE_WORD_K)
+#define GCODE_UPDATE_L          (1 << GCODE_WORD_L)
+#define GCODE_UPDATE_P          (1 << GCODE_WORD_P)
+#define GCODE_UPDATE_Q          (1 << GCODE_WORD_Q)
+#define GCODE_UPDATE_R          (1 << GCODE_WORD_R)
+#define GCODE_UPDATE_S          (1 << GCODE_WORD_S)
+#define GCODE_UPDATE_STRING     (1 << (GCODE_WORD_MAX + 0))
+#define GCODE_UPDATE_ERROR      (1 << (GCODE_WORD_MAX + 1))
+
+/* Only the words present in update_mask are stored in
+ * value[], in update_mask bit order. Use gcode_value()
+ * to fetch them.
+ *
+ * Strings are not stored in the block at all, but in the
+ * GCode string arena. Only unbuffered M codes take a string,
+ * and they are run as soon as they are parsed.
+ */
 struct gcode_block {
     struct gcode_block *next;
     struct gcode_io *io;
@@ -76,19 +90,43 @@ struct gcode_block {
     int  cmd;
     int  num;
     uint16_t update_mask;
-    float axis[AXIS_MAX];
-    float f;        /* feed rate */
-    float i;        /* x center of arc */
-    float j;        /* y center of arc */
-    float k;        /* z center of arc */
-    float l;        /* parameter */
-    float p;        /* parameter */
-    float q;        /* parameter */
-    float r;        /* parameter */
-    float s;        /* parameter */
-    char string[PATH_MAX];    /* For M20, M28, M29, M30, M32, M36, M117 */
+    float value[GCODE_VALUE_MAX];
 };
 
+/* While the queue is full, one buffered block per input is
+ * parsed into 'hold', and queued (and acknowledged) once there
+ * is room. A buffered line after it is left 'waiting', unparsed,
+ * in the line buffer, and input stops there.
+ */
+struct gcode_io {
+    bool enable;
+    bool held, waiting;
+    struct gcode_line line;
+    struct gcode_block hold;
+    Stream *in, *out;
+};
+
+static inline float gcode_value(const struct gcode_block *blk, uint16_t word_mask)
+{
+    uint16_t below = blk->update_mask & (word_mask - 1);
+    uint8_t n;
+
+    if (!(blk->update_mask & word_mask))
+        return 0.0;
+
+    for (n = 0; below; n++)
+        below &= below - 1;
+
+    return blk->value[n];
+}
+
+/* Fill in all the axis words, 0 for ones that are not present */
+static inline void gcode_axis(const struct gcode_block *blk, float *pos)
+{
+    for (int i = 0; i < AXIS_MAX; i++)
+        pos[i] = gcode_value(blk, GCODE_UPDATE_AXIS(i));
+}
+
 class GCode {
     private:
         Visualize *_vis;
@@ -107,6 +145,60 @@ class GCode {
             struct gcode_block *active;
             struct gcode_block *pending, **pending_tail;
         } _block;
+        struct gcode_stats _stats;
+
+        /* G2/G3 arc in progress. The arc's block stays active,
+         * and update() sends it one chord at a time.
+         */
+        struct {
+            int16_t segments;           /* Chords left to send */
+            int16_t n;                  /* Chords sent */
+            uint8_t axis_mask;
+            float center[2];            /* X, Y */
+            float r0[2];                /* Center to the start */
+            float r[2];                 /* Center to the last chord end */
+            float cos_t, sin_t;         /* Rotation per chord */
+            float theta;                /* Angle per chord */
+            float start[AXIS_MAX];
+            float delta[AXIS_MAX];      /* Linear travel, for Z and E */
+        } _arc;
+
+        /* M640 layer cycle. The settings are kept between cycles,
+         * so a bare M640 repeats the last layer. The block stays
+         * active until the last phase is done.
+         */
+        struct {
+            enum {
+                LAYER_IDLE = 0,
+                LAYER_SEEK,             /* Drop Z, move to the first pass
+                                         * (raising E, if not fusing) */
+                LAYER_FUSE,             /* Fuse the inked layer */
+                LAYER_RETURN,           /* Raise E, back to the start */
+                LAYER_RECOAT,           /* Sweep powder over the bed */
+                LAYER_DONE,
+            } phase;
+            float height;               /* Layer height, mm */
+            float ratio;                /* E raise per mm of Z drop */
+            float recoat_rate;          /* Recoat feed, mm/minute */
+            float dwell;                /* Fuse pass, ms (0 = no fuse) */
+            float x_start, x_end;       /* Travel extents, mm */
+            float margin;               /* Around the ink, mm (< 0: off) */
+            bool armed;                 /* Fuser was armed before */
+        } _layer;
+        Tool *_wait_tool;               /* M116 waiting on this tool */
+        struct {
+            uint8_t axes;               /* Faulted axes, queue held */
+            bool paused;                /* SD program paused by us */
+        } _fault;
+
+        /* Inked X/Y bounding box of the current layer, in mm.
+         * Cleared at the end of each M640 layer cycle.
+         */
+        struct {
+            bool valid;
+            float min[2], max[2];
+        } _ink;
+        char _string[GCODE_STRING_MAX];
         enum { ABSOLUTE = 0, RELATIVE } _positioning;
         float _units_to_mm;
         float _feed_rate;
@@ -135,13 +227,15 @@ class GCode {
             _debug = &_null;
 
             _console.enable = true;
+            _console.held = _console.waiting = false;
             _console.in = _stream;
             _console.out = _stream;
 
-            _console.out->println("start");
+            _console.out->println(F("start"));
 
 #if ENABLE_SD
             _program.enable = true;
+            _program.held = _program.waiting = false;
             _program.in = _cnc->program();
             _program.out = &_null;
 #endif
@@ -152,10 +246,45 @@ class GCode {
 
             _block.free = &_block.ring[0];
             _block.pending_tail = &_block.pending;
+
+            _stats.lines = 0;
+            _stats.blocks = 0;
+            _stats.starved = 0;
+
+            _arc.segments = 0;
+
+            _layer.phase = _layer.LAYER_IDLE;
+            _wait_tool = NULL;
+            _fault.axes = 0;
+            _fault.paused = false;
+            _layer.height = LAYER_HEIGHT_MM;
+            _layer.ratio = LAYER_FEED_RATIO;
+            _layer.recoat_rate = LAYER_RECOAT_FEED;
+            _layer.dwell = LAYER_FUSE_MS;
+            _layer.x_start = LAYER_X_START;
+            _layer.x_end = LAYER_X_END;
+            _layer.margin = LAYER_INK_MARGIN;
+            _ink.valid = false;
         }
 
         void update(bool cnc_active);
 
+        /* Number of blocks pending or active */
+        int queue_used()
+        {
+            int used = _block.active ? 1 : 0;
+
+            for (struct gcode_block *blk = _block.pending; blk; blk = blk->next)
+                used++;
+
+            return used;
+        }
+
+        const struct gcode_stats *stats()
+        {
+            return &_stats;
+        }
+
 #if ENABLE_SD
         bool file_select(const char *filename, bool start = false)
         {
@@ -185,6 +314,18 @@ class GCode {
 #endif
 
     private:
+        void _arc_begin(struct gcode_block *blk, bool clockwise);
+        void _arc_next();
+        void _layer_begin(struct gcode_block *blk);
+        void _layer_next();
+        bool _fault_hold();
+        bool _layer_span(float *lo, float *hi);
+        int _ink_pattern(int id);
+        int _ink_nozzles();
+        void _ink_track(const float *from, const float *to);
+        void _layer_tool(int tool_id);
+        void _feed_set(struct gcode_block *blk);
+        void _vis_feed(struct gcode_block *blk);
         void _block_do(struct gcode_block *blk);
         bool _line_parse(struct gcode_line *line, struct gcode_block *blk);
         void _process_io(struct gcode_io *io);
@@ -33,13 +33,23 @@ class InkBar : public Tool, public Axis {
     private:
         static const int DEBUG = 0;
 	static const int TIMEOUT_MS = 100;
+        static const int FIFO_MAX = 8;
         BrundleInk _ink;
         float _mm_min, _mm_max;
-        float _dotlines_per_mm;
         int32_t _dotline, _dotline_max;
+        int32_t _blank;         /* Blank dotlines, not yet sent */
         uint16_t _pattern, _sprays;
         unsigned long _next_status, _next_motor;
 
+        /* Commands waiting for the printhead, sent one per update()
+         * so that several heads can be driven at once.
+         */
+        struct {
+            char cmd;
+            uint16_t val;
+        } _fifo[FIFO_MAX];
+        uint8_t _fifo_head, _fifo_len;
+
 	enum inkbar_state {
 	    STATE_IDLE = 0,
 	    STATE_HOME,
@@ -54,10 +64,13 @@ class InkBar : public Tool, public Axis {
         {
             _mm_min = mm_min;
             _mm_max = mm_max;
-            _dotlines_per_mm = dotlines_per_mm;
             _dotline_max = (_mm_max - _mm_min) * dotlines_per_mm;
+            units_set(dotlines_per_mm);
 	    _state = STATE_IDLE;
 	    _sprays = 4;
+            _dotline = 0;
+            _blank = 0;
+            _fifo_head = _fifo_len = 0;
         }
 
         virtual void begin()
@@ -71,8 +84,10 @@ class InkBar : public Tool, public Axis {
         virtual void stop(void)
         {
             /* Flush any pending dots */
-            if (_dotline > 0)
+            if (_queued() > 0)
                 _ink_forward(micros());
+            else
+                _dotline = _blank = 0;
 
             Tool::stop();
         }
@@ -93,7 +108,7 @@ if (DEBUG) {
 if (DEBUG) {
     Serial.print("parm: Spray ");Serial.println(_sprays);
 }
-                _ink.cmd('s', _sprays-1);
+                _queue('s', _sprays-1);
                 break;
             default:
                 break;
@@ -116,6 +131,12 @@ if (DEBUG) {
                 _next_status = us_now + 100L * 1000;
             }
 
+            /* Queued commands go out while the carriage is parked */
+            if (_state == STATE_IDLE && _fifo_len > 0) {
+                _send(us_now);
+                return true;
+            }
+
 if (DEBUG) {
     if (motor_timeout)
         Serial.print(" **TIMEOUT**");
@@ -128,6 +149,7 @@ if (DEBUG) {
                     if (motor_timeout || !_ink.motor_on()) {
                         _state = STATE_IDLE;
                         _dotline = 0;
+                        _blank = 0;
                     }
                     break;
             case STATE_INK_FORWARD:
@@ -149,6 +171,7 @@ if (DEBUG) {
                     break;
             case STATE_INK_CLEAR:
                     _dotline = 0;
+                    _blank = 0;
                     _state = STATE_IDLE;
                     break;
             }
@@ -163,13 +186,17 @@ if (DEBUG && in_state != _state) {
                 _ink.send('?');
             }
 
+            time_deadline(_next_status);
+            if (_state != STATE_IDLE)
+                time_deadline(_next_motor);
+
             return motor_active();
         }
 
         /* Axis commands */
         virtual bool motor_active()
         {
-            return (_state != STATE_IDLE);
+            return (_state != STATE_IDLE) || (_fifo_len > 0);
         }
 
         virtual void home(float mm = 0.0)
@@ -181,6 +208,8 @@ if (DEBUG) {
             while (_ink.busy())
                 _ink.recv();
 
+            /* Anything not yet sent is for a pass that won't happen */
+            _fifo_len = 0;
             _ink.send('h');
 	    _state = STATE_HOME;
             _next_motor = micros() + (_sprays + 1) * _dotline_max * 1000;
@@ -188,12 +217,18 @@ if (DEBUG) {
             Axis::home(mm);
         }
 
-        virtual void target_set(float mm, unsigned long ms)
+        /* InkBar units are dotlines. Only a started (selected or
+         * armed) tool lays down ink, the others just keep count.
+         */
+        virtual void target_set_ustep(int32_t pos, unsigned long ms)
         {
-            int32_t pos = mm * _dotlines_per_mm;
+            uint16_t pattern = active() ? _pattern : 0;
 
             /* Moving backwards? Ink the bar... */
-            if (pos < _dotline) {
+            if (pos < _dotline && _queued() == 0) {
+                /* ..unless it is all blank, so there is nothing to do */
+                _dotline = _blank = 0;
+            } else if (pos < _dotline) {
                 /* If the tool is still active, move forward */
                 if (active()) {
 if (DEBUG) Serial.println("target_set: Inking forward");
@@ -202,44 +237,82 @@ if (DEBUG) Serial.println("target_set: Inking forward");
 if (DEBUG) Serial.println("target_set: Inking reverse");
                     _ink_reverse(micros());
                 }
+            } else if (_dotline != pos && pattern == 0) {
+                /* Blank dotlines are only sent ahead of the next inked
+                 * one, as a single run. Trailing ones are never sent.
+                 */
+                _blank += pos - _dotline;
+                _dotline = pos;
             } else if (_dotline != pos) {
 if (DEBUG) Serial.print("target_set: Repeat ");
 if (DEBUG) Serial.println(pos - _dotline);
-                while (_ink.busy())
-                    _ink.recv();
-                if ((pos - _dotline) > 1) {
-                    _ink.cmd('l',_pattern);
-                    _ink.send('r', (pos - _dotline) - 1);
-                } else {
-                    _ink.send('l',_pattern);
+                if (_blank > 0) {
+                    _queue('l', 0);
+                    if (_blank > 1)
+                        _queue('r', _blank - 1);
+                    _blank = 0;
                 }
+                _queue('l', pattern);
+                if ((pos - _dotline) > 1)
+                    _queue('r', (pos - _dotline) - 1);
                 _dotline = pos;
             }
 
-            Axis::target_set(mm, ms);
+            Axis::target_set_ustep(pos, ms);
         }
 
 private:
+        /* Dotlines sent to the printhead's queue */
+        int32_t _queued()
+        {
+            return _dotline - _blank;
+        }
+
+        /* Queue a command, waiting for room if need be */
+        void _queue(char cmd, uint16_t val = 0)
+        {
+            while (_fifo_len >= FIFO_MAX)
+                update(micros());
+
+            uint8_t tail = (_fifo_head + _fifo_len) % FIFO_MAX;
+            _fifo[tail].cmd = cmd;
+            _fifo[tail].val = val;
+            _fifo_len++;
+        }
+
+        /* Send the oldest queued command. The ink passes
+         * start the carriage when they go out.
+         */
+        void _send(unsigned long us_now)
+        {
+            char cmd = _fifo[_fifo_head].cmd;
+
+            _ink.send(cmd, _fifo[_fifo_head].val);
+            _fifo_head = (_fifo_head + 1) % FIFO_MAX;
+            _fifo_len--;
+
+            if (cmd == 'i' || cmd == 'j') {
+                _state = (cmd == 'i') ? STATE_INK_FORWARD : STATE_INK_REVERSE;
+                _next_motor = us_now + _sprays * _dotline_max * 1000L;
+if (DEBUG) {
+    Serial.print("MODE: 0 => ");Serial.println(_state);
+}
+            }
+        }
+
         void _ink_forward(unsigned long us_now)
         {
-            while (_state != STATE_IDLE)
-                update(us_now);
+            /* Trailing blank dotlines were never sent */
+            _blank = 0;
 
-            _state = STATE_INK_FORWARD;
-            _ink.send('i');
-            _next_motor = us_now + _sprays * _dotline_max * 1000L;
-if (DEBUG) Serial.println("MODE: 0 => 2");
+            _queue('i');
         }
 
         void _ink_reverse(unsigned long us_now)
         {
-            while (_state != STATE_IDLE)
-                update(us_now);
+            _blank = 0;
 
-            _state = STATE_INK_REVERSE;
-            _ink.send('j');
-            _next_motor = us_now + _sprays * _dotline_max * 1000L;
-if (DEBUG) Serial.println("MODE: 0 => 3");
+            _queue('j');
         }
 
  };
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INKHEADS_H
+#define INKHEADS_H
+
+#include "Axis.h"
+#include "ToolHead.h"
+#include "InkBar.h"
+
+#define INKHEADS_MAX    4
+
+/* The Y axis, shared by several InkBar printheads (each on its own
+ * serial port, and each its own ink tool). Every head sees every
+ * move, so that they all keep count of their dotlines, but only the
+ * selected and armed (M641) heads lay down ink - concurrently, as
+ * each head's commands are sent from its own update().
+ *
+ * A head's G10 L1 Y offset, relative to the selected tool's, shifts
+ * its dotlines so the heads line up on Y. X offsets (ie staggered
+ * heads) are fixed by the shared X axis.
+ */
+class InkHeads : public Axis {
+    private:
+        ToolHead *_toolhead;
+        int _heads;
+        struct {
+            int id;                     /* Tool id */
+            InkBar *bar;
+        } _head[INKHEADS_MAX];
+
+    public:
+        InkHeads(ToolHead *toolhead)
+        {
+            _toolhead = toolhead;
+            _heads = 0;
+        }
+
+        /* Add a printhead, as tool 'id'. The first sets the units */
+        bool attach(int id, InkBar *bar)
+        {
+            if (_heads >= INKHEADS_MAX || !_toolhead->attach(id, (Tool *)bar, true))
+                return false;
+
+            if (_heads == 0)
+                units_set(bar->usteps_per_mm());
+
+            _head[_heads].id = id;
+            _head[_heads].bar = bar;
+            _heads++;
+            return true;
+        }
+
+        virtual void begin()
+        {
+            Axis::begin();
+
+            for (int i = 0; i < _heads; i++)
+                _head[i].bar->begin();
+        }
+
+        virtual bool motor_active()
+        {
+            for (int i = 0; i < _heads; i++) {
+                if (_head[i].bar->motor_active())
+                    return true;
+            }
+
+            return false;
+        }
+
+        virtual void target_set_ustep(int32_t ustep, unsigned long ms = 0)
+        {
+            const float *offset = _toolhead->tool()->offset_is();
+            int selected = _toolhead->selected();
+
+            Axis::target_set_ustep(ustep, ms);
+
+            for (int i = 0; i < _heads; i++) {
+                int32_t pos = ustep;
+
+                if (_head[i].id != selected) {
+                    const float *head = _head[i].bar->offset_is();
+                    pos += mm_to_ustep(offset[AXIS_Y] - head[AXIS_Y]);
+                    if (pos < 0)
+                        pos = 0;
+                }
+
+                _head[i].bar->target_set_ustep(pos, ms);
+            }
+        }
+
+        virtual bool update(unsigned long us_now)
+        {
+            bool active = false;
+
+            for (int i = 0; i < _heads; i++)
+                active |= _head[i].bar->update(us_now);
+
+            return active;
+        }
+};
+
+#endif /* INKHEADS_H */
+/* vim: set shiftwidth=4 expandtab:  */
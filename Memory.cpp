@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "Memory.h"
+
+#ifdef __AVR__
+
+#define MEMORY_PAINT        0xc5
+#define MEMORY_PAINT_MARGIN 32          /* Bytes left unpainted below SP */
+
+extern char __heap_start;
+extern char *__brkval;
+
+static char *_heap_top(void)
+{
+    return __brkval ? __brkval : &__heap_start;
+}
+
+void memory_paint(void)
+{
+    char *p, *end;
+
+    end = (char *)SP - MEMORY_PAINT_MARGIN;
+    for (p = _heap_top(); p < end; p++)
+        *p = MEMORY_PAINT;
+}
+
+size_t memory_free(void)
+{
+    char top;
+
+    return &top - _heap_top();
+}
+
+size_t memory_stack_unused(void)
+{
+    char *p, *end;
+
+    end = (char *)SP;
+    for (p = _heap_top(); p < end && *p == (char)MEMORY_PAINT; p++);
+
+    return p - _heap_top();
+}
+
+#else /* !__AVR__ */
+
+void memory_paint(void)
+{
+}
+
+size_t memory_free(void)
+{
+    return MEMORY_UNKNOWN;
+}
+
+size_t memory_stack_unused(void)
+{
+    return MEMORY_UNKNOWN;
+}
+
+#endif /* __AVR__ */
+
+/* vim: set shiftwidth=4 expandtab:  */
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+
+/* Returned by memory_free() and memory_stack_unused() on targets
+ * where the figure cannot be measured (the host simulator).
+ */
+#define MEMORY_UNKNOWN      ((size_t)-1)
+
+/* Paint the unused stack area with a sentinel, so that
+ * memory_stack_unused() can find the stack's high water mark.
+ *
+ * Call once, as early as possible in setup().
+ */
+void memory_paint(void);
+
+/* Bytes between the top of the heap and the current stack pointer.
+ */
+size_t memory_free(void);
+
+/* Bytes of painted stack that have never been touched.
+ */
+size_t memory_stack_unused(void);
+
+#endif /* MEMORY_H */
+/* vim: set shiftwidth=4 expandtab:  */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "Profile.h"
+
+#if ENABLE_PROFILE
+
+/* In enum profile_e order */
+static const char _profile_name[PROFILE_MAX][8] PROGMEM = {
+    "loop", "axis", "tool", "ui", "gcode", "serial", "sd", "vis",
+};
+
+static struct profile_slot {
+    unsigned long count;
+    unsigned long total;        /* usec */
+    unsigned long min, max;     /* usec */
+} _profile[PROFILE_MAX];
+
+void profile_add(enum profile_e id, unsigned long us)
+{
+    struct profile_slot *ps = &_profile[id];
+
+    if (ps->count == 0 || us < ps->min)
+        ps->min = us;
+    if (us > ps->max)
+        ps->max = us;
+    ps->total += us;
+    ps->count++;
+}
+
+void profile_report(Print *out)
+{
+    for (int i = 0; i < PROFILE_MAX; i++) {
+        struct profile_slot *ps = &_profile[i];
+
+        out->print(' ');
+        out->print((const __FlashStringHelper *)_profile_name[i]);
+        out->print(':');
+        out->print(ps->count);
+        out->print('/');
+        out->print(ps->min);
+        out->print('/');
+        out->print(ps->count ? ps->total / ps->count : 0);
+        out->print('/');
+        out->print(ps->max);
+    }
+}
+
+void profile_reset(void)
+{
+    for (int i = 0; i < PROFILE_MAX; i++) {
+        _profile[i].count = 0;
+        _profile[i].total = 0;
+        _profile[i].min = 0;
+        _profile[i].max = 0;
+    }
+}
+
+#endif /* ENABLE_PROFILE */
+
+/* vim: set shiftwidth=4 expandtab:  */
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+class Print;
+
+/* Loop time accounting, per subsystem. Times are inclusive:
+ * PROFILE_GCODE also counts the PROFILE_SERIAL and PROFILE_SD
+ * time spent inside it, and PROFILE_LOOP counts everything.
+ */
+enum profile_e {
+    PROFILE_LOOP = 0,
+    PROFILE_AXIS,               /* Axis updates */
+    PROFILE_TOOL,               /* Active tool update */
+    PROFILE_UI,                 /* Joystick and menus */
+    PROFILE_GCODE,              /* G-code queue and input */
+    PROFILE_SERIAL,             /* Console input */
+    PROFILE_SD,                 /* SD program input */
+    PROFILE_VIS,                /* Toolpath preview */
+    PROFILE_MAX
+};
+
+#if ENABLE_PROFILE
+
+/* Time the code between PROFILE_START(id) and PROFILE_STOP(id),
+ * which must be in the same scope.
+ */
+#define PROFILE_START(id)   unsigned long _profile_##id = micros()
+#define PROFILE_STOP(id)    profile_add(id, micros() - _profile_##id)
+
+void profile_add(enum profile_e id, unsigned long us);
+
+/* Print " name:count/min/avg/max" (usec) for each subsystem
+ */
+void profile_report(Print *out);
+
+void profile_reset(void);
+
+#else /* !ENABLE_PROFILE */
+
+#define PROFILE_START(id)   do { } while (0)
+#define PROFILE_STOP(id)    do { } while (0)
+
+#endif /* ENABLE_PROFILE */
+
+#endif /* PROFILE_H */
+/* vim: set shiftwidth=4 expandtab:  */
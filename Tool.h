@@ -87,7 +87,7 @@ class Tool {
         virtual void offset_set(float *pos, uint8_t axis_mask)
         {
             for (int j = 0; j < AXIS_MAX; j++) {
-                if ((1 << j) && axis_mask)
+                if ((1 << j) & axis_mask)
                     _offset[j] = pos[j];
             }
         }
@@ -18,8 +18,9 @@
 #ifndef TOOLFUSER_H
 #define TOOLFUSER_H
 
-#include "Tool.h"
+#include <avr/pgmspace.h>
 
+#include "Tool.h"
 
 // r0: 250000
 // t0: 25
@@ -28,10 +29,10 @@
 // beta: 4066
 // max adc: 1023
 #define NUMTEMPS 20
-static struct {
+static const struct {
         short adc;
         short celsius;
-} const temptable[NUMTEMPS] = {
+} temptable[NUMTEMPS] PROGMEM = {
    {1, -1},
    {54, 78},
    {107, 101},
@@ -132,15 +133,19 @@ class ToolFuser : public Tool {
             /* Overheat protection */
             short adc = analogRead(_temp_pin);
 
+            short adc_lo = (short)pgm_read_word(&temptable[0].adc);
+
             for (int i = 1; i < NUMTEMPS; i++) {
-                if (temptable[i-1].adc <= adc &&
-                    temptable[i].adc > adc) {
-                    _temp = map(adc, temptable[i-1].adc,
-                                     temptable[i].adc,
-                                     temptable[i-1].celsius,
-                                     temptable[i].celsius);
+                short adc_hi = (short)pgm_read_word(&temptable[i].adc);
+
+                if (adc_lo <= adc && adc_hi > adc) {
+                    _temp = map(adc, adc_lo, adc_hi,
+                                (short)pgm_read_word(&temptable[i-1].celsius),
+                                (short)pgm_read_word(&temptable[i].celsius));
                     break;
                 }
+
+                adc_lo = adc_hi;
             }
 
             if (_temp > _limit_max) {
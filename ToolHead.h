@@ -33,6 +33,8 @@ class ToolHead : Tool {
         struct {
             int id;
             Tool *tool;
+            bool armed;         /* Kept running when not selected */
+            bool driven;        /* Updated as an axis, not by update() */
         } _map[MAX_TOOLS];
 
         Tool _tool_null;
@@ -43,25 +45,34 @@ class ToolHead : Tool {
         {
             _map[0].id = 0;
             _map[0].tool = &_tool_null;
+            _map[0].armed = false;
+            _map[0].driven = false;
             _tools = 1;
             _id = _map[0].id;
             _tool = _map[0].tool;
         }
 
-        virtual bool attach(int id, Tool *tool)
+        /* A tool that is also an axis (ie an InkBar) is 'driven':
+         * the CNC axis pass already updates it, so update() here
+         * leaves it alone.
+         */
+        virtual bool attach(int id, Tool *tool, bool driven = false)
         {
             if (_tools >= MAX_TOOLS || id <= 0)
                 return false;
 
             for (int i = 0; i < _tools; i++) {
                 if (_map[i].id == id) {
-                    _map[_tools].tool = tool;
+                    _map[i].tool = tool;
+                    _map[i].driven = driven;
                     return true;
                 }
             }
 
             _map[_tools].id = id;
             _map[_tools].tool = tool;
+            _map[_tools].armed = false;
+            _map[_tools].driven = driven;
             _tools++;
             return true;
         }
@@ -102,6 +113,68 @@ class ToolHead : Tool {
         {
             return _id;
         }
+
+        /* Arm a tool, so that it runs in the background (ie pre-heats)
+         * while other tools are selected. An armed tool is not stopped
+         * when it is deselected. Disarming stops it, unless it is the
+         * selected tool.
+         */
+        virtual bool arm(int tool, bool armed = true)
+        {
+            for (int i = 0; i < _tools; i++) {
+                if (_map[i].id != tool)
+                    continue;
+
+                _map[i].armed = armed;
+                if (armed && !_map[i].tool->active())
+                    _map[i].tool->start();
+                else if (!armed && _map[i].id != _id)
+                    _map[i].tool->stop();
+                return true;
+            }
+
+            return false;
+        }
+
+        virtual bool armed(int tool = -1)
+        {
+            if (tool < 0)
+                tool = _id;
+
+            for (int i = 0; i < _tools; i++) {
+                if (_map[i].id == tool)
+                    return _map[i].armed;
+            }
+
+            return false;
+        }
+
+        /* Stop the selected tool and every armed tool */
+        virtual void halt()
+        {
+            for (int i = 0; i < _tools; i++) {
+                if (_map[i].armed || _map[i].id == _id)
+                    _map[i].tool->stop();
+                _map[i].armed = false;
+            }
+        }
+
+        /* Update every running tool - the selected one and any
+         * armed ones - on every pass, whether or not the axes are
+         * moving, so thermostats (and their overheat cutoff) keep
+         * regulating while parked.
+         */
+        virtual bool update(unsigned long us_now)
+        {
+            bool busy = false;
+
+            for (int i = 0; i < _tools; i++) {
+                if (!_map[i].driven && _map[i].tool->active())
+                    busy |= _map[i].tool->update(us_now);
+            }
+
+            return busy;
+        }
 };
 
 #endif /* TOOLHEAD_H */
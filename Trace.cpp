@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "Axis.h"
+#include "Trace.h"
+
+#if ENABLE_TRACE
+
+static const char _trace_axis[AXIS_MAX] = { 'X', 'Y', 'Z', 'E' };
+
+static struct {
+    struct trace_step ring[TRACE_MAX];
+    uint8_t head;               /* Next slot to write */
+    uint8_t count;
+    unsigned long recorded;
+} _trace;
+
+void trace_step(uint8_t axis, int dir, unsigned long due, unsigned long at)
+{
+    struct trace_step *ts = &_trace.ring[_trace.head];
+
+    ts->axis = axis | ((dir < 0) ? TRACE_NEG : 0);
+    ts->due = due;
+    ts->at = at;
+
+    _trace.head = (_trace.head + 1) % TRACE_MAX;
+    if (_trace.count < TRACE_MAX)
+        _trace.count++;
+    _trace.recorded++;
+
+#ifdef __SIMAVR__
+    simavr_trace(axis, dir, due, at);
+#endif
+}
+
+void trace_clear(void)
+{
+    _trace.head = 0;
+    _trace.count = 0;
+    _trace.recorded = 0;
+}
+
+unsigned long trace_recorded(void)
+{
+    return _trace.recorded;
+}
+
+int trace_dump(Print *out)
+{
+    uint8_t i = (_trace.head + TRACE_MAX - _trace.count) % TRACE_MAX;
+
+    for (int n = 0; n < _trace.count; n++) {
+        struct trace_step *ts = &_trace.ring[i];
+        uint8_t axis = ts->axis & ~TRACE_NEG;
+
+        out->print(F("\nstep "));
+        out->print((axis < AXIS_MAX) ? _trace_axis[axis] : '?');
+        out->print((ts->axis & TRACE_NEG) ? F(" - ") : F(" + "));
+        out->print(ts->due);
+        out->print(' ');
+        out->print(ts->at);
+
+        i = (i + 1) % TRACE_MAX;
+    }
+
+    return _trace.count;
+}
+
+#endif /* ENABLE_TRACE */
+
+/* vim: set shiftwidth=4 expandtab:  */
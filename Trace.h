@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+class Print;
+
+/* Step events are traced as lines of the form:
+ *
+ *   step <axis> <+|-> <due usec> <issued usec>
+ *
+ * See simavr/trace.awk for the jitter analysis.
+ */
+#define TRACE_NEG       0x80    /* Axis byte flag: negative step */
+
+struct trace_step {
+    uint8_t axis;               /* AXIS_* | TRACE_NEG */
+    unsigned long due;          /* When the step was scheduled */
+    unsigned long at;           /* When the step was issued */
+};
+
+#if ENABLE_TRACE
+
+/* Record a step in the trace ring, overwriting the oldest.
+ */
+void trace_step(uint8_t axis, int dir, unsigned long due, unsigned long at);
+
+/* Empty the trace ring, and reset the recorded count.
+ */
+void trace_clear(void);
+
+/* Steps recorded since the last trace_clear()
+ */
+unsigned long trace_recorded(void);
+
+/* Print the ring, oldest first, one "\nstep ..." line per event.
+ * Returns the number of events printed.
+ */
+int trace_dump(Print *out);
+
+#else /* !ENABLE_TRACE */
+
+static inline void trace_step(uint8_t axis, int dir, unsigned long due, unsigned long at)
+{
+}
+
+#endif /* ENABLE_TRACE */
+
+#endif /* TRACE_H */
+/* vim: set shiftwidth=4 expandtab:  */
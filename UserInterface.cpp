@@ -21,7 +21,7 @@
 
 static MenuMain UserInterfaceMenuMain;
 
-static const float menu_axis_incr[] = {
+static const float menu_axis_incr[] PROGMEM = {
     -100.0,
     -10.0,
     -1.0,
@@ -35,44 +35,86 @@ static const float menu_axis_incr[] = {
 
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof((x)[0]))
 
+/* Format v with two decimals, right aligned in width characters */
+static void ui_format(char *buf, int width, float v)
+{
+    char tmp[12];
+    int n = 0;
+    long fixed = (long)(v * 100 + ((v < 0) ? -0.5 : 0.5));
+    bool neg = (fixed < 0);
+
+    if (neg)
+        fixed = -fixed;
+
+    do {
+        tmp[n++] = '0' + (fixed % 10);
+        fixed /= 10;
+        if (n == 2)
+            tmp[n++] = '.';
+    } while (fixed || n < 4);
+
+    if (neg)
+        tmp[n++] = '-';
+
+    for (; width > n; width--)
+        *(buf++) = ' ';
+    while (n > 0)
+        *(buf++) = tmp[--n];
+    *buf = 0;
+}
+
 static void axis_report(UserInterface *ui, int col, int row, int sel_axis = -1)
 {
-    uint16_t bg, fg, st;
+    char buf[UI_TEXT_COLS + 1];
     float pos[AXIS_MAX];
     CNC *cnc = ui->cnc();
     float temp_k = ui->cnc()->tool()->kelvin();
-
-    bg = ui->color(UI_COLOR_BACKGROUND);
-    fg = ui->color(UI_COLOR_TEXT);
-    st = ui->color(UI_COLOR_STATUS);
-
     int tool = ui->cnc()->toolhead()->selected();
-    ui->setTextCursor(col, row);
-    ui->setTextColor(tool ? st : fg, bg);
-    ui->print("T");
-    ui->print(tool);
+    int n;
+
+    buf[0] = 'T';
+    n = 1;
+    if (tool >= 10)
+        buf[n++] = '0' + (tool / 10) % 10;
+    buf[n++] = '0' + tool % 10;
     if (temp_k > 0) {
-        ui->print("  ");
-        ui->print(temp_k - 273.16);
-        ui->print("C");
+        buf[n++] = ' ';
+        buf[n++] = ' ';
+        ui_format(&buf[n], 0, temp_k - 273.16);
+        n = strlen(buf);
+        buf[n++] = 'C';
     }
-    ui->print("        ");
+    while (n < UI_TEXT_COLS)
+        buf[n++] = ' ';
+    buf[n] = 0;
+
+    ui->text_at(col, row, buf, tool ? UI_COLOR_STATUS : UI_COLOR_TEXT,
+                UI_COLOR_BACKGROUND);
 
     cnc->position_get(pos);
 
     for (int i = 0; i < AXIS_MAX; i++) {
         bool selected = sel_axis == i;
-        ui->setTextCursor(col + 1 + (1 + 1 + 1 + 3 + 1 + 2 + 1) * (i >> 1), row + 1 + (i & 1));
-        ui->setTextColor(selected ? st : fg, bg);
-        ui->print("XYZE"[i]); ui->print(":");
-        if (sel_axis < 0)
-            ui->setTextColor(cnc->axis_active(i) ? st : fg, bg);
-        else
-            ui->setTextColor(selected ? bg : fg, selected ? fg : bg);
-
-        ui->print(" ");
-        ui->print(pos[i], 2);
-        ui->print(" ");
+        int x = col + 1 + (1 + 1 + 1 + 3 + 1 + 2 + 1) * (i >> 1);
+        int y = row + 1 + (i & 1);
+        int fg, bg;
+
+        buf[0] = "XYZE"[i];
+        buf[1] = ':';
+        buf[2] = 0;
+        ui->text_at(x, y, buf, selected ? UI_COLOR_STATUS : UI_COLOR_TEXT,
+                    UI_COLOR_BACKGROUND);
+
+        if (sel_axis < 0) {
+            fg = cnc->axis_active(i) ? UI_COLOR_STATUS : UI_COLOR_TEXT;
+            bg = UI_COLOR_BACKGROUND;
+        } else {
+            fg = selected ? UI_COLOR_BACKGROUND : UI_COLOR_TEXT;
+            bg = selected ? UI_COLOR_TEXT : UI_COLOR_BACKGROUND;
+        }
+
+        ui_format(buf, 7, pos[i]);
+        ui->text_at(x + 2, y, buf, fg, bg);
     }
 }
 
@@ -84,7 +126,7 @@ class MenuAxis : public Menu {
     public:
         void begin(UserInterface *ui)
         {
-            ui->clear("Manual Move");
+            ui->clear(F("Manual Move"));
             _axis = 0;
             _incr = ARRAY_SIZE(menu_axis_incr)/2;
             _sel = SEL_INCR;
@@ -127,21 +169,23 @@ class MenuAxis : public Menu {
                     return &UserInterfaceMenuMain;
             }
 
+            float incr = pgm_read_float(&menu_axis_incr[_incr]);
+
             if (key == UI_KEY_SELECT) {
-                if (menu_axis_incr[_incr] == 0) {
+                if (incr == 0) {
                     ui->cnc()->home(1 << _axis);
                 } else {
                     float pos[AXIS_MAX];
 
                     ui->cnc()->target_get(pos);
-                    pos[_axis] += menu_axis_incr[_incr];
+                    pos[_axis] += incr;
                     ui->cnc()->target_set(pos, (1 << _axis));
                 }
             }
 
             ui->setTextWrap(false);
             ui->setTextColor(fg, bg);
-            ui->print("Axis:");
+            ui->print(F("Axis:"));
 
             if (_sel == SEL_AXIS)
                 ui->setTextColor(fg, st);
@@ -152,16 +196,16 @@ class MenuAxis : public Menu {
             ui->print(" ");
 
             ui->setTextColor(fg, bg);
-            ui->print(" Incr:");
+            ui->print(F(" Incr:"));
             if (_sel == SEL_INCR)
                 ui->setTextColor(fg, st);
             else
                 ui->setTextColor(st, bg);
             ui->print(" ");
-            if (menu_axis_incr[_incr] == 0)
-                ui->print("HOME");
+            if (incr == 0)
+                ui->print(F("HOME"));
             else
-                ui->print(menu_axis_incr[_incr], 2);
+                ui->print(incr, 2);
             ui->print(" ");
             ui->setTextColor(fg, bg);
             ui->print("    ");
@@ -174,10 +218,33 @@ class MenuAxis : public Menu {
 static MenuAxis UserInterfaceMenuAxis;
 
 #if ENABLE_SD
+/* Directory index. Only a window of entries is kept, but the
+ * directory offset of every MENUSD_WINDOW'th entry is remembered,
+ * so any window can be reloaded without walking the whole directory.
+ */
+#define MENUSD_NAME_MAX 13      /* 8.3 name, plus NUL */
+#define MENUSD_WINDOW   8
+#define MENUSD_MARKS    32
+
+struct sd_entry {
+    char name[MENUSD_NAME_MAX];
+    bool dir;
+    uint32_t size;
+    uint32_t offset;
+};
+
 class MenuSD : public Menu {
     private:
         File _file;
-        uint16_t _sel, _ith, _max;
+        uint16_t _sel, _ith;
+
+        struct {
+            struct sd_entry entry[MENUSD_WINDOW];
+            uint16_t base, count;           /* First entry cached, and how many */
+            uint16_t total;                 /* Entries in the directory, once known */
+            uint32_t mark[MENUSD_MARKS];    /* Offset of entry n * MENUSD_WINDOW */
+            uint8_t marks;
+        } _index;
 
     public:
         void begin(UserInterface *ui)
@@ -195,8 +262,13 @@ class MenuSD : public Menu {
                 _file = SD.open("");
 
             _ith = 0;
-            _max = ~0;
             _sel = 0;
+
+            _index.base = 0;
+            _index.count = 0;
+            _index.total = ~0;
+            _index.mark[0] = 0;
+            _index.marks = 1;
         }
 
         Menu *update(UserInterface *ui, unsigned long now, enum ui_key key)
@@ -213,7 +285,7 @@ class MenuSD : public Menu {
                 return this;
 
             name = _file.name();
-            ui->clear("SD: ", name[0] ? name : "/");
+            ui->clear(F("SD: "), name[0] ? name : "/");
 
             if (_file.isDirectory())
                 return _update_dir(ui, now, key);
@@ -222,6 +294,73 @@ class MenuSD : public Menu {
         }
 
     private:
+        /* Load the index window starting at entry 'base',
+         * from the nearest remembered offset.
+         */
+        void _index_load(UserInterface *ui, uint16_t base)
+        {
+            uint16_t i, mark;
+            int len = ui->cols() - 1;
+            File tmp;
+
+            if (len > MENUSD_NAME_MAX - 1)
+                len = MENUSD_NAME_MAX - 1;
+
+            mark = base / MENUSD_WINDOW;
+            if (mark >= _index.marks)
+                mark = _index.marks - 1;
+
+            _file.seek(_index.mark[mark]);
+            _index.base = base;
+            _index.count = 0;
+
+            for (i = mark * MENUSD_WINDOW; i < base + MENUSD_WINDOW; i++) {
+                uint32_t offset = _file.position();
+
+                if ((i % MENUSD_WINDOW) == 0 &&
+                    (i / MENUSD_WINDOW) == _index.marks &&
+                    _index.marks < MENUSD_MARKS)
+                    _index.mark[_index.marks++] = offset;
+
+                tmp = _file.openNextFile();
+                if (!tmp) {
+                    _index.total = i;
+                    break;
+                }
+
+                if (i >= base) {
+                    struct sd_entry *ent = &_index.entry[_index.count++];
+
+                    strncpy(ent->name, tmp.name(), len);
+                    ent->name[len] = 0;
+                    ent->dir = tmp.isDirectory();
+                    ent->size = ent->dir ? 0 : tmp.size();
+                    ent->offset = offset;
+                }
+
+                tmp.close();
+            }
+        }
+
+        /* Entry i from the index, reloading the window if needed */
+        struct sd_entry *_index_get(UserInterface *ui, uint16_t i)
+        {
+            if (i >= _index.total)
+                return NULL;
+
+            if (i < _index.base || i >= _index.base + _index.count) {
+                uint16_t rows = ui->rows();
+
+                /* Center the window on the display */
+                _index_load(ui, (i > (MENUSD_WINDOW - rows) / 2) ?
+                                 i - (MENUSD_WINDOW - rows) / 2 : 0);
+                if (i < _index.base || i >= _index.base + _index.count)
+                    return NULL;
+            }
+
+            return &_index.entry[i - _index.base];
+        }
+
         /* SD: /dir
          *  fname1
          * /dirname
@@ -232,6 +371,8 @@ class MenuSD : public Menu {
         {
             uint16_t fg, bg;
             uint16_t rows = ui->rows();
+            uint16_t max = _index.total;
+            struct sd_entry *ent;
             File tmp;
 
             switch (key) {
@@ -244,10 +385,10 @@ class MenuSD : public Menu {
                 }
                 break;
             case UI_KEY_DOWN:
-                if (_ith < _max) {
+                if (_ith < max) {
                     _ith++;
                     _sel++;
-                } else if (_sel < _max) {
+                } else if (_sel < max) {
                     _sel++;
                 }
                 break;
@@ -262,21 +403,20 @@ class MenuSD : public Menu {
                     return this;
                 } else {
                     _ith -= rows;
-                    _sel += rows;
+                    _sel -= rows;
                 }
                 break;
             case UI_KEY_RIGHT:
-                if ((_ith + rows) < _max) {
+                if ((_ith + rows) < max) {
                     _ith += rows;
                     _sel += rows;
                 }
                 break;
             case UI_KEY_SELECT:
-                _file.rewindDirectory();
-                for (uint16_t i = 0; i < _sel; i++) {
-                    tmp = _file.openNextFile();
-                    tmp.close();
-                }
+                ent = _index_get(ui, _sel);
+                if (!ent)
+                    break;
+                _file.seek(ent->offset);
                 tmp = _file.openNextFile();
                 begin(ui, &tmp);
                 update(ui, 0, UI_KEY_NONE);
@@ -285,36 +425,28 @@ class MenuSD : public Menu {
                 break;
             }
 
-            _file.rewindDirectory();
-            for (uint16_t i = 0; i < _ith; i++) {
-                tmp = _file.openNextFile();
-                if (!tmp) {
-                    _max = i;
-                    _ith = (i - 1);
-                    break;
-                }
-                tmp.close();
+            /* Past the end? */
+            if (!_index_get(ui, _ith) && _ith > 0 && _index.total != (uint16_t)~0) {
+                _ith = _index.total ? _index.total - 1 : 0;
+                if (_sel > _ith)
+                    _sel = _ith;
             }
 
             bg = ui->color(UI_COLOR_BACKGROUND);
             fg = ui->color(UI_COLOR_TEXT);
 
             ui->setTextWrap(false);
-            for (uint16_t i = 0; i < (_max - _ith) && i < rows; i++) {
-                tmp = _file.openNextFile();
-                if (!tmp)
+            for (uint16_t i = 0; i < rows; i++) {
+                ent = _index_get(ui, _ith + i);
+                if (!ent)
                     break;
                 if ((_ith + i) == _sel)
                     ui->setTextColor(bg, fg);
                 else
                     ui->setTextColor(fg, bg);
                 ui->setTextCursor(0, i);
-                if (tmp.isDirectory())
-                    ui->print("/");
-                else
-                    ui->print(" ");
-                ui->print(tmp.name());
-                tmp.close();
+                ui->print(ent->dir ? "/" : " ");
+                ui->print(ent->name);
             }
 
             return this;
@@ -395,15 +527,41 @@ bool UserInterface::update(enum ui_key key)
     return (_menu != &UserInterfaceMenuMain);
 }
 
-void UserInterface::clear(const char *title, const char *subtitle)
+void UserInterface::text_at(int16_t col, int16_t row, const char *text, int fg, int bg)
+{
+    uint8_t attr = (fg << 4) | bg;
+
+    if (row < 0 || row >= UI_TEXT_ROWS)
+        return;
+
+    for (; *text && col < UI_TEXT_COLS; text++, col++) {
+        if (col < 0)
+            continue;
+
+        if (_text.c[row][col] == *text && _text.color[row][col] == attr)
+            continue;
+
+        _text.c[row][col] = *text;
+        _text.color[row][col] = attr;
+
+        /* Text rows start below the title bar */
+        drawChar(col * 6, (row + 1) * 8, *text, _color[fg], _color[bg], 1);
+    }
+
+    flush();
+}
+
+void UserInterface::_clear(int tlen, const char *subtitle)
 {
     uint16_t bg, fg;
-    int tlen = strlen(title);
     int slen = subtitle ? strlen(subtitle) : 0;
 
     bg = color(UI_COLOR_BACKGROUND);
     fg = color(UI_COLOR_TEXT);
 
+    /* Nothing drawn in any text cell */
+    memset(_text.c, 0, sizeof(_text.c));
+
     fillScreen(bg);
     fillRect(0, 0, width(), 8, fg);
 
@@ -415,15 +573,29 @@ void UserInterface::clear(const char *title, const char *subtitle)
     } else {
         setCursor((width() - tlen*6)/2, 0);
     }
+}
+
+void UserInterface::clear(const char *title, const char *subtitle)
+{
+    _clear(strlen(title), subtitle);
+
+    print(title);
+    if (subtitle)
+        print(subtitle);
+}
+
+void UserInterface::clear(const __FlashStringHelper *title, const char *subtitle)
+{
+    _clear(strlen_P((PGM_P)title), subtitle);
 
     print(title);
-    if (slen)
+    if (subtitle)
         print(subtitle);
 }
 
 void MenuMain::begin(UserInterface *ui)
 {
-    ui->clear("BrundleFab");
+    ui->clear(F("BrundleFab"));
 }
 
 Menu *MenuMain::update(UserInterface *ui, unsigned long now, enum ui_key key)
@@ -36,6 +36,10 @@ enum ui_key {
 #define UI_COLOR_STATUS         2
 #define UI_COLOR_MAX            3
 
+/* Text cells remembered by UserInterface::text_at() */
+#define UI_TEXT_COLS            21
+#define UI_TEXT_ROWS            4
+
 class UserInterface;
 
 class Menu {
@@ -67,8 +71,16 @@ class UserInterface : public WindowGFX {
 
         Menu *_menu;
 
+        /* Last character, and colors, drawn in each text cell */
+        struct {
+            char c[UI_TEXT_ROWS][UI_TEXT_COLS];
+            uint8_t color[UI_TEXT_ROWS][UI_TEXT_COLS];
+        } _text;
+
+        void _clear(int tlen, const char *subtitle);
+
     public:
-        UserInterface(CNC *cnc, Adafruit_GFX *gfx, int w, int h, int left, int top) : WindowGFX(gfx, w, h, left, top)
+        UserInterface(CNC *cnc, Adafruit_ST7735 *gfx, int w, int h, int left, int top) : WindowGFX(gfx, w, h, left, top)
         {
             _cnc = cnc;
 
@@ -95,9 +107,16 @@ class UserInterface : public WindowGFX {
         void begin();
 
         void clear(const char *title, const char *subtitle = NULL);
+        void clear(const __FlashStringHelper *title, const char *subtitle = NULL);
 
         bool update(enum ui_key key = UI_KEY_NONE);
 
+        /* Draw text at a cell, in the fg and bg UI colors,
+         * redrawing only the cells that have changed since
+         * the last text_at() or clear().
+         */
+        void text_at(int16_t col, int16_t row, const char *text, int fg, int bg);
+
         void setTextCursor(int16_t col, int16_t row)
         {
             WindowGFX::setTextCursor(col, row + 1);
@@ -15,6 +15,7 @@
  *
  */
 
+#include "config.h"
 #include "Visualize.h"
 
 void Visualize::_pixel2d_clipped(uint16_t color, const struct point *pt)
@@ -61,18 +62,16 @@ static int ComputeOutCode(int x, int y, int w, int h)
     return code;
 }
 
-static uint16_t r5g6b5(const float *color_a, const float *cinc, int pixel)
+static uint16_t r5g6b5(const struct vcolor *c)
 {
-    return (((int)((color_a[0] + cinc[0] * pixel) * 31) & 0x1f) << 11) |
-           (((int)((color_a[1] + cinc[1] * pixel) * 63) & 0x3f) << 5) |
-           (((int)((color_a[2] + cinc[2] * pixel) * 31) & 0x1f) << 0);
+    return ((c->r >> 8) << 11) | ((c->g >> 8) << 5) | ((c->b >> 8) << 0);
 }
 
 // Cohen–Sutherland clipping algorithm clips a line from
 // P0 = (x0, y0) to P1 = (x1, y1) against a rectangle with
 // diagonal from (0, 0) to (_width, _height).
-void Visualize::_line2d_clipped(const float *color_a, const struct point *a,
-                                const float *color_b, const struct point *b)
+void Visualize::_line2d_clipped(const struct vcolor *color_a, const struct point *a,
+                                const struct vcolor *color_b, const struct point *b)
 {
     int x0, y0, x1, y1;
 
@@ -144,14 +143,17 @@ void Visualize::_line2d_clipped(const float *color_a, const struct point *a,
     signed char const iy((delta_y > 0) - (delta_y < 0));
     delta_y = abs(delta_y) << 1;
 
-    float dist = sqrt((x1 - x0)*(x1 - x0) + (y1 - y0)*(y1 - y0));
-    float cinc[3];
-    int pixel = 0;
+    /* Step the colour once per pixel along the major axis */
+    int steps = (delta_x > delta_y ? delta_x : delta_y) >> 1;
+    struct vcolor c = *color_a, cinc = {};
 
-    for (int i = 0; i < 3; i++)
-        cinc[i] = (color_b[i] - color_a[i])/dist;
+    if (steps) {
+        cinc.r = (color_b->r - color_a->r) / steps;
+        cinc.g = (color_b->g - color_a->g) / steps;
+        cinc.b = (color_b->b - color_a->b) / steps;
+    }
 
-    drawPixel(x0, y0, r5g6b5(color_a, cinc, pixel++));
+    drawPixel(x0, y0, r5g6b5(&c));
 
     if (delta_x >= delta_y)
     {
@@ -170,7 +172,10 @@ void Visualize::_line2d_clipped(const float *color_a, const struct point *a,
             error += delta_y;
             x0 += ix;
 
-            drawPixel(x0, y0, r5g6b5(color_a, cinc, pixel++));
+            c.r += cinc.r;
+            c.g += cinc.g;
+            c.b += cinc.b;
+            drawPixel(x0, y0, r5g6b5(&c));
         }
     }
     else
@@ -190,53 +195,353 @@ void Visualize::_line2d_clipped(const float *color_a, const struct point *a,
             error += delta_x;
             y0 += iy;
 
-            drawPixel(x0, y0, r5g6b5(color_a, cinc, pixel++));
+            c.r += cinc.r;
+            c.g += cinc.g;
+            c.b += cinc.b;
+            drawPixel(x0, y0, r5g6b5(&c));
         }
     }
 }
 
-static void fcolor(float *c, uint16_t r5g6b5, float y, float max_y)
+/* Scale the colour by dim/256 */
+void Visualize::_dim(struct vcolor *c, uint16_t r5g6b5, int32_t dim)
+{
+    if (dim < 0)
+        dim = 0;
+    else if (dim > 256)
+        dim = 256;
+
+    c->r = ((r5g6b5 >> 11) & 0x1f) * dim;
+    c->g = ((r5g6b5 >>  5) & 0x3f) * dim;
+    c->b = ((r5g6b5 >>  0) & 0x1f) * dim;
+}
+
+/* Isometric outline of the build volume */
+void Visualize::_frame()
 {
-    float dim;
+    float zero[AXIS_MAX] = {};
+    int32_t old_origin[AXIS_MAX];
+
+    memcpy(old_origin, _origin, sizeof(_origin));
+    memset(_origin, 0, sizeof(_origin));
+
+    for (int i = 0; i < AXIS_MAX; i++) {
+        float pos[AXIS_MAX] = {};
+        pos[i] = _max[i];
+        cursor_to(zero);
+        line_to(VC_AXIS + i, pos);
+    }
+
+    cursor_to(0, 0, _max[AXIS_Z]);
+    line_to(VC_AXIS + AXIS_Y, 0, _max[AXIS_Y], _max[AXIS_Z]);
+    line_to(VC_AXIS + AXIS_Z, 0, _max[AXIS_Y], 0);
+    line_to(VC_AXIS + AXIS_X, _max[AXIS_X], _max[AXIS_Y], 0);
+    line_to(VC_AXIS + AXIS_Z, _max[AXIS_X], _max[AXIS_Y], _max[AXIS_Z]);
+    line_to(VC_AXIS + AXIS_Y, _max[AXIS_X], 0, _max[AXIS_Z]);
+    line_to(VC_AXIS + AXIS_Z, _max[AXIS_X], 0, 0);
+    line_to(VC_AXIS + AXIS_Y, _max[AXIS_X], _max[AXIS_Y], 0);
+    cursor_to(0, 0, _max[AXIS_Z]);
+    line_to(VC_AXIS + AXIS_X, _max[AXIS_X], 0, _max[AXIS_Z]);
+
+    memcpy(_origin, old_origin, sizeof(_origin));
+}
+
+void Visualize::clear()
+{
+    fillScreen(_color[VC_BACKGROUND]);
 
     /* Scale a bit so that the back of the build box
      * isn't completely black
      */
-    max_y *= 1.5;
+    _depth = _mm_to_q(_max[AXIS_Y] * 1.5);
+    if (_depth < 1)
+        _depth = 1;
+
+    /* Coverage map cells span the whole build area */
+    _map.per_col = (_mm_to_q(_max[AXIS_X]) + VIS_MAP_COLS - 1) / VIS_MAP_COLS;
+    _map.per_row = (_mm_to_q(_max[AXIS_Y]) + VIS_MAP_ROWS - 1) / VIS_MAP_ROWS;
+    if (_map.per_col < 1)
+        _map.per_col = 1;
+    if (_map.per_row < 1)
+        _map.per_row = 1;
+
+    for (int i = 0; i < VIS_MAP_LEVELS; i++) {
+        struct vcolor c;
+        _dim(&c, _color[VC_TOOL], (i << 8) / (VIS_MAP_LEVELS - 1));
+        _map.color[i] = i ? r5g6b5(&c) : _color[VC_BACKGROUND];
+    }
+
+    memset(_map.dirty, 0xff, sizeof(_map.dirty));
+    _map.row = 0;
 
-    dim = (max_y - y) / max_y;
-    c[0] = ((r5g6b5 >> 11) & 0x1f) / 31.0 * dim;
-    c[1] = ((r5g6b5 >>  5) & 0x3f) / 63.0 * dim;
-    c[2] = ((r5g6b5 >>  0) & 0x1f) / 31.0 * dim;
+    if (_mode == VIS_MODE_WIREFRAME)
+        _frame();
+
+    /* The projection may have changed, so drop the preview */
+    _queue.count = 0;
+    _flatten(_queue.position, &_queue.point);
+    _queue.from = _queue.point;
+    _queue.depth = _queue.position[AXIS_Y];
+}
+
+/* Fade the colour with distance along Y */
+void Visualize::_shade(struct vcolor *c, uint16_t r5g6b5, int32_t y)
+{
+    _dim(c, r5g6b5, ((_depth - y) << 8) / _depth);
 }
 
 void Visualize::line_to(int ndx, const float *pos)
 {
     struct point loc;
+    int32_t q[AXIS_MAX];
 
-    _flatten(pos, &loc);
+    for (int i = 0; i < AXIS_MAX; i++)
+        q[i] = _mm_to_q(pos[i]);
+
+    _flatten(q, &loc);
 
     if (ndx >= 0 && ndx < VC_MAX) {
-        float c1[3], c2[3];
-        fcolor(c1, _color[ndx], _cursor.position[AXIS_Y], _max[AXIS_Y]);
-        fcolor(c2, _color[ndx], pos[AXIS_Y], _max[AXIS_Y]);
-        _line2d_clipped(c1, &_cursor.point, c2, &loc);
+        struct vcolor c1, c2;
+        _shade(&c1, _color[ndx], _cursor.position[AXIS_Y]);
+        _shade(&c2, _color[ndx], q[AXIS_Y]);
+        _line2d_clipped(&c1, &_cursor.point, &c2, &loc);
+        flush();
     }
 
     for (int i = 0; i < AXIS_MAX; i++)
-        _cursor.position[i] = pos[i];
+        _cursor.position[i] = q[i];
     _cursor.point = loc;
 }
 
 void Visualize::pixel_at(int ndx, const float *pos)
 {
     struct point loc;
+    int32_t q[AXIS_MAX];
 
     if (ndx < 0 || ndx >= VC_MAX)
         return;
 
-    _flatten(pos, &loc);
+    for (int i = 0; i < AXIS_MAX; i++)
+        q[i] = _mm_to_q(pos[i]);
+
+    _flatten(q, &loc);
     _pixel2d_clipped(_color[ndx], &loc);
+    flush();
+}
+
+void Visualize::move_to(int ndx, const float *pos)
+{
+    struct point loc;
+    struct vseg *seg;
+
+    for (int i = 0; i < AXIS_MAX; i++)
+        _queue.position[i] = _mm_to_q(pos[i]);
+
+    _flatten(_queue.position, &loc);
+
+    if (ndx < 0 || ndx >= VC_MAX)
+        ndx = VC_INVISIBLE;
+
+    seg = NULL;
+    if (_queue.count) {
+        seg = &_queue.ring[(_queue.head + _queue.count - 1) % VIS_QUEUE_MAX];
+
+        /* Coalesce sub-pixel segments, and runs of invisible moves */
+        if (!((loc.x == _queue.point.x && loc.y == _queue.point.y) ||
+              (ndx == VC_INVISIBLE && seg->color_ndx == VC_INVISIBLE)))
+            seg = NULL;
+    }
+
+    if (!seg) {
+        /* Full - make room without drawing; only update() draws */
+        if (_queue.count == VIS_QUEUE_MAX)
+            _queue_merge();
+
+        seg = &_queue.ring[(_queue.head + _queue.count) % VIS_QUEUE_MAX];
+        seg->color_ndx = ndx;
+        _queue.count++;
+    }
+
+    seg->to = loc;
+    seg->depth = _queue.position[AXIS_Y];
+    _queue.point = loc;
+}
+
+/* Draw, and retire, the oldest queued segment */
+void Visualize::_queue_draw()
+{
+    struct vseg *seg = &_queue.ring[_queue.head];
+
+    if (_mode == VIS_MODE_WIREFRAME && seg->color_ndx != VC_INVISIBLE) {
+        struct vcolor c1, c2;
+
+        _shade(&c1, _color[seg->color_ndx], _queue.depth);
+        _shade(&c2, _color[seg->color_ndx], seg->depth);
+        _line2d_clipped(&c1, &_queue.from, &c2, &seg->to);
+        flush();
+    }
+
+    _queue.from = seg->to;
+    _queue.depth = seg->depth;
+    _queue.head = (_queue.head + 1) % VIS_QUEUE_MAX;
+    _queue.count--;
+}
+
+/* Fold the oldest queued segment into the next one. An invisible
+ * move is simply retired; a visible one becomes part of a single
+ * chord to the next segment's end point.
+ */
+void Visualize::_queue_merge()
+{
+    struct vseg *seg = &_queue.ring[_queue.head];
+    struct vseg *next;
+
+    if (seg->color_ndx == VC_INVISIBLE) {
+        _queue.from = seg->to;
+        _queue.depth = seg->depth;
+    } else {
+        next = &_queue.ring[(_queue.head + 1) % VIS_QUEUE_MAX];
+        next->color_ndx = seg->color_ndx;
+    }
+
+    _queue.head = (_queue.head + 1) % VIS_QUEUE_MAX;
+    _queue.count--;
+}
+
+bool Visualize::update(unsigned long us_slice)
+{
+    unsigned long us_start = micros();
+
+    if (_mode == VIS_MODE_COVERAGE) {
+        _queue.count = 0;
+        _queue.from = _queue.point;
+        _queue.depth = _queue.position[AXIS_Y];
+        return _map_update(us_start, us_slice);
+    }
+
+    while (_queue.count) {
+        _queue_draw();
+
+        if ((micros() - us_start) >= us_slice)
+            break;
+    }
+
+    return _queue.count > 0;
+}
+
+void Visualize::_map_mark(int col, int row)
+{
+    unsigned int bit = (row * VIS_MAP_COLS + col) * VIS_MAP_BITS;
+    uint8_t *cell = &_map.cell[bit / 8];
+    uint8_t shift = bit % 8;
+
+    if (((*cell >> shift) & (VIS_MAP_LEVELS - 1)) == (VIS_MAP_LEVELS - 1))
+        return;
+
+    *cell += 1 << shift;
+    _map.dirty[row / 8] |= 1 << (row % 8);
+}
+
+uint8_t Visualize::_map_level(int col, int row)
+{
+    unsigned int bit = (row * VIS_MAP_COLS + col) * VIS_MAP_BITS;
+
+    return (_map.cell[bit / 8] >> (bit % 8)) & (VIS_MAP_LEVELS - 1);
+}
+
+void Visualize::ink_to(const float *pos, uint16_t pattern)
+{
+    int32_t x, y, z;
+    int first, last;
+    int c0, c1, r0, r1;
+
+    x = _mm_to_q(pos[AXIS_X]) - _origin[AXIS_X];
+    y = _mm_to_q(pos[AXIS_Y]) - _origin[AXIS_Y];
+    z = _mm_to_q(pos[AXIS_Z]);
+
+    /* New layer? */
+    if (z != _map.z) {
+        _map.z = z;
+        memset(_map.cell, 0, sizeof(_map.cell));
+        memset(_map.dirty, 0xff, sizeof(_map.dirty));
+    }
+
+    /* Ink is only laid down as the bar sweeps forward along Y;
+     * returns and X-only moves just track the position.
+     */
+    r0 = _map.y;
+    r1 = y;
+    _map.y = y;
+
+    if (r1 <= r0)
+        return;
+
+    pattern &= (1 << INK_NOZZLES) - 1;
+    if (!pattern)
+        return;
+
+    /* Nozzles spread along X from the head position */
+    for (first = 0; !(pattern & (1 << first)); first++);
+    for (last = INK_NOZZLES - 1; !(pattern & (1 << last)); last--);
+
+    c0 = x + _mm_to_q(first * INK_NOZZLE_MM);
+    c1 = x + _mm_to_q(last * INK_NOZZLE_MM);
+
+    if (c1 < 0 || r1 < 0)
+        return;
+
+    c0 = (c0 < 0) ? 0 : c0 / _map.per_col;
+    c1 = c1 / _map.per_col;
+    r0 = (r0 < 0) ? 0 : r0 / _map.per_row;
+    r1 = r1 / _map.per_row;
+
+    if (c1 >= VIS_MAP_COLS)
+        c1 = VIS_MAP_COLS - 1;
+    if (r1 >= VIS_MAP_ROWS)
+        r1 = VIS_MAP_ROWS - 1;
+
+    for (int row = r0; row <= r1; row++)
+        for (int col = c0; col <= c1; col++)
+            _map_mark(col, row);
+}
+
+/* Draw one row of the map, in runs of the same level */
+void Visualize::_map_draw(int row)
+{
+    int y = height() - (row + 1) * VIS_MAP_CELL;
+    int col, run;
+
+    for (col = 0; col < VIS_MAP_COLS; col += run) {
+        uint8_t level = _map_level(col, row);
+
+        for (run = 1; col + run < VIS_MAP_COLS; run++) {
+            if (_map_level(col + run, row) != level)
+                break;
+        }
+
+        fillRect(col * VIS_MAP_CELL, y, run * VIS_MAP_CELL, VIS_MAP_CELL,
+                 _map.color[level]);
+    }
+}
+
+bool Visualize::_map_update(unsigned long us_start, unsigned long us_slice)
+{
+    for (int i = 0; i < VIS_MAP_ROWS; i++) {
+        int row = _map.row;
+
+        _map.row = (_map.row + 1) % VIS_MAP_ROWS;
+
+        if (!(_map.dirty[row / 8] & (1 << (row % 8))))
+            continue;
+
+        _map.dirty[row / 8] &= ~(1 << (row % 8));
+        _map_draw(row);
+
+        if ((micros() - us_start) >= us_slice)
+            return true;
+    }
+
+    return false;
 }
 
 /* vim: set shiftwidth=4 expandtab:  */
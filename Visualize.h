@@ -32,23 +32,83 @@
 
 #define VC_MAX          (AXIS_MAX + 4)
 
+/* Positions are kept in fixed point, 1/VIS_Q_PER_MM mm per unit */
+#define VIS_Q_SHIFT     4
+#define VIS_Q_PER_MM    (1 << VIS_Q_SHIFT)
+
+/* Pixels per position unit, as a 16 bit fraction */
+#define VIS_SCALE_SHIFT 16
+
 struct point {
     int x, y;
 };
 
+/* Preview segments waiting to be drawn */
+#define VIS_QUEUE_MAX   8
+
+/* Preview modes */
+#define VIS_MODE_WIREFRAME      0       /* Isometric toolpath */
+#define VIS_MODE_COVERAGE       1       /* Top-down ink coverage of the layer */
+
+/* Coverage map, in cells of VIS_MAP_CELL pixels square, each
+ * VIS_MAP_BITS deep. 64x60 cells covers the 128x120 preview area.
+ */
+#define VIS_MAP_CELL    2
+#define VIS_MAP_BITS    1
+#define VIS_MAP_COLS    64
+#define VIS_MAP_ROWS    60
+#define VIS_MAP_LEVELS  (1 << VIS_MAP_BITS)
+
+/* r5g6b5 channels, with 8 bits of fraction */
+struct vcolor {
+    int16_t r, g, b;
+};
+
 class Visualize : public WindowGFX {
     private:
-        float _scale, _max[AXIS_MAX], _origin[AXIS_MAX];
+        float _max[AXIS_MAX];
+        int32_t _origin[AXIS_MAX];
+        int32_t _scale;         /* Pixels per unit, << VIS_SCALE_SHIFT */
+        int32_t _depth;         /* Y depth at which colors fade to black */
 
         uint16_t _color[VC_MAX];
 
         struct {
             struct point point;
-            float position[AXIS_MAX];
+            int32_t position[AXIS_MAX];
         } _cursor;
 
+        /* Deferred toolpath preview. Segments are projected
+         * when queued, and drawn later by update().
+         */
+        struct vseg {
+            struct point to;
+            int32_t depth;
+            int8_t color_ndx;
+        };
+
+        struct {
+            struct vseg ring[VIS_QUEUE_MAX];
+            uint8_t head, count;
+            int32_t position[AXIS_MAX];     /* Last queued position */
+            struct point point;             /* ..and its projection */
+            struct point from;              /* Last drawn point */
+            int32_t depth;                  /* ..and its depth */
+        } _queue;
+
+        uint8_t _mode;
+
+        struct {
+            uint8_t cell[(VIS_MAP_COLS * VIS_MAP_ROWS * VIS_MAP_BITS + 7) / 8];
+            uint8_t dirty[(VIS_MAP_ROWS + 7) / 8];
+            uint16_t color[VIS_MAP_LEVELS];
+            int32_t per_col, per_row;       /* Position units per cell */
+            int32_t y, z;                   /* Last inked Y, and layer */
+            uint8_t row;                    /* Next row to redraw */
+        } _map;
+
     public:
-        Visualize(Adafruit_GFX *gfx, int width, int height,
+        Visualize(Adafruit_ST7735 *gfx, int width, int height,
                   int x = 0, int y = 0)
             : WindowGFX(gfx, width, height, x, y)
         {
@@ -60,38 +120,12 @@ class Visualize : public WindowGFX {
             _color[VC_BACKGROUND] = 0;
         }
 
-        void clear()
-        {
-            float zero[AXIS_MAX] = {}, old_origin[AXIS_MAX];
-            fillScreen(_color[VC_BACKGROUND]);
-
-            memcpy(old_origin, _origin, sizeof(_origin));
-            memcpy(_origin, zero, sizeof(_origin));
-
-            for (int i = 0; i < AXIS_MAX; i++) {
-                float pos[AXIS_MAX] = {};
-                pos[i] = _max[i];
-                cursor_to(zero);
-                line_to(VC_AXIS + i, pos);
-            }
-
-            cursor_to(0, 0, _max[AXIS_Z]);
-            line_to(VC_AXIS + AXIS_Y, 0, _max[AXIS_Y], _max[AXIS_Z]);
-            line_to(VC_AXIS + AXIS_Z, 0, _max[AXIS_Y], 0);
-            line_to(VC_AXIS + AXIS_X, _max[AXIS_X], _max[AXIS_Y], 0);
-            line_to(VC_AXIS + AXIS_Z, _max[AXIS_X], _max[AXIS_Y], _max[AXIS_Z]);
-            line_to(VC_AXIS + AXIS_Y, _max[AXIS_X], 0, _max[AXIS_Z]);
-            line_to(VC_AXIS + AXIS_Z, _max[AXIS_X], 0, 0);
-            line_to(VC_AXIS + AXIS_Y, _max[AXIS_X], _max[AXIS_Y], 0);
-            cursor_to(0, 0, _max[AXIS_Z]);
-            line_to(VC_AXIS + AXIS_X, _max[AXIS_X], 0, _max[AXIS_Z]);
-
-            memcpy(_origin, old_origin, sizeof(_origin));
-        }
+        void clear();
 
         void clear(float scale)
         {
-            _scale = scale;
+            /* Pixels per mm, to pixels per position unit */
+            _scale = scale * (1L << VIS_SCALE_SHIFT) / VIS_Q_PER_MM;
             clear();
         }
 
@@ -110,9 +144,9 @@ class Visualize : public WindowGFX {
 
         void origin(float x, float y, float z)
         {
-            _origin[AXIS_X] = x;
-            _origin[AXIS_Y] = y;
-            _origin[AXIS_Z] = z;
+            _origin[AXIS_X] = _mm_to_q(x);
+            _origin[AXIS_Y] = _mm_to_q(y);
+            _origin[AXIS_Z] = _mm_to_q(z);
 
             clear();
         }
@@ -122,10 +156,21 @@ class Visualize : public WindowGFX {
             _color[color_ndx] = color;
         }
 
+        void mode_set(uint8_t mode)
+        {
+            _mode = mode;
+            clear();
+        }
+
+        uint8_t mode()
+        {
+            return _mode;
+        }
+
         void cursor_to(const float *pos)
         {
             for (int i = 0; i < AXIS_MAX; i++)
-                _cursor.position[i] = pos[i];
+                _cursor.position[i] = _mm_to_q(pos[i]);
 
             _flatten(_cursor.position, &_cursor.point);
         }
@@ -134,6 +179,22 @@ class Visualize : public WindowGFX {
 
         void pixel_at(int color_ndx, const float *pos);
 
+        /* Queue a preview move to pos, drawn in color_ndx
+         * (or not at all, for VC_INVISIBLE) by update().
+         */
+        void move_to(int color_ndx, const float *pos);
+
+        /* Draw queued preview segments for at most us_slice
+         * microseconds. Returns true if any remain.
+         */
+        bool update(unsigned long us_slice);
+
+        /* Record an inking move to pos, with the given nozzle
+         * pattern, in the coverage map. A change of Z starts
+         * a new layer.
+         */
+        void ink_to(const float *pos, uint16_t pattern);
+
         void cursor_to(float x, float y, float z)
         {
             float pos[AXIS_MAX] = { x, y, z };
@@ -153,18 +214,37 @@ class Visualize : public WindowGFX {
         }
 
     private:
-        void _flatten(const float *pos, struct point *pt)
+        int32_t _mm_to_q(float mm)
+        {
+            return (int32_t)(mm * VIS_Q_PER_MM);
+        }
+
+        /* The Y axis recedes up and to the right, at 1/4 scale */
+        void _flatten(const int32_t *pos, struct point *pt)
         {
-            pt->x = ((pos[AXIS_X] - _origin[AXIS_X]) +
-                     (pos[AXIS_Y] - _origin[AXIS_Y])/4.0) * _scale + 1;
+            int32_t y_q = (pos[AXIS_Y] - _origin[AXIS_Y]) >> 2;
+
+            pt->x = (((pos[AXIS_X] - _origin[AXIS_X]) + y_q) * _scale
+                     >> VIS_SCALE_SHIFT) + 1;
             pt->y = (height() - 1) -
-                    ((pos[AXIS_Z] - _origin[AXIS_Z]) +
-                     (pos[AXIS_Y] - _origin[AXIS_Y])/4) * _scale - 1;
+                    (((pos[AXIS_Z] - _origin[AXIS_Z]) + y_q) * _scale
+                     >> VIS_SCALE_SHIFT) - 1;
         }
 
+        void _dim(struct vcolor *c, uint16_t r5g6b5, int32_t dim);
+        void _shade(struct vcolor *c, uint16_t r5g6b5, int32_t y);
+
+        void _frame();
+        void _queue_draw();
+        void _queue_merge();
+        void _map_mark(int col, int row);
+        uint8_t _map_level(int col, int row);
+        void _map_draw(int row);
+        bool _map_update(unsigned long us_start, unsigned long us_slice);
+
         void _pixel2d_clipped(uint16_t color, const struct point *pt);
-        void _line2d_clipped(const float *a_color, const struct point *a,
-                             const float *b_color, const struct point *b);
+        void _line2d_clipped(const struct vcolor *a_color, const struct point *a,
+                             const struct vcolor *b_color, const struct point *b);
 
 };
 
@@ -19,16 +19,36 @@
 #define WINDOWGFX_H
 
 #include <Adafruit_GFX.h>
+#include <Adafruit_ST7735.h>
+
+/* Largest block of pixels batched into one address window.
+ * One 6x8 text cell fits.
+ */
+#define WINDOWGFX_RECT_MAX      48
 
 class WindowGFX : public Adafruit_GFX {
     private:
-        Adafruit_GFX *_gfx;
+        Adafruit_ST7735 *_gfx;
         int16_t _w, _h;
         int16_t _x, _y;
         int8_t _rot;
 
+        /* Pending dirty rectangle, in display coordinates.
+         * Pixels are kept in the order they were drawn: runs of
+         * 'w' pixels along (dx, dy), the runs stacked along (sx, sy)
+         * starting at (x, y). w is 0 until the first run ends.
+         */
+        struct {
+            int16_t x, y;
+            int8_t dx, dy;
+            int8_t sx, sy;
+            uint8_t w;
+            uint8_t len;
+            uint16_t color[WINDOWGFX_RECT_MAX];
+        } _rect;
+
     public:
-        WindowGFX(Adafruit_GFX *gfx, int16_t w, int16_t h, int x = 0, int y = 0)
+        WindowGFX(Adafruit_ST7735 *gfx, int16_t w, int16_t h, int x = 0, int y = 0)
             : Adafruit_GFX(w, h)
         {
             _gfx = gfx;
@@ -36,6 +56,35 @@ class WindowGFX : public Adafruit_GFX {
             _h = h;
             _x = x;
             _y = y;
+            _rect.len = 0;
+        }
+
+        /* Push any pending pixels to the display */
+        void flush()
+        {
+            uint8_t w, rows;
+
+            if (_rect.len == 0)
+                return;
+
+            if (_rect.len == 1) {
+                _gfx->drawPixel(_rect.x, _rect.y, _rect.color[0]);
+                _rect.len = 0;
+                return;
+            }
+
+            /* Whole runs go out as one rectangle, a trailing
+             * partial run as a span after it.
+             */
+            w = _rect.w ? _rect.w : _rect.len;
+            rows = _rect.len / w;
+            _push(0, _rect.x, _rect.y, w, rows);
+            if (_rect.len > rows * w)
+                _push(rows * w,
+                      _rect.x + _rect.sx * rows, _rect.y + _rect.sy * rows,
+                      _rect.len - rows * w, 1);
+
+            _rect.len = 0;
         }
 
         /* Standard Adafruit_GFX character cell size is 6x8 */
@@ -58,11 +107,34 @@ class WindowGFX : public Adafruit_GFX {
         virtual void drawPixel(int16_t x, int16_t y, uint16_t color)
         {
             _rotate_xy(&x, &y, x, y);
-            _gfx->drawPixel(x, y, color);
+
+            if (_rect.len > 0 && _rect.len < WINDOWGFX_RECT_MAX &&
+                _rect_next(x - _rect.x, y - _rect.y)) {
+                _rect.color[_rect.len++] = color;
+                return;
+            }
+
+            flush();
+
+            _rect.x = x;
+            _rect.y = y;
+            _rect.dx = _rect.dy = 0;
+            _rect.sx = _rect.sy = 0;
+            _rect.w = 0;
+            _rect.color[0] = color;
+            _rect.len = 1;
+        }
+
+        virtual size_t write(uint8_t c)
+        {
+            size_t res = Adafruit_GFX::write(c);
+            flush();
+            return res;
         }
 
         virtual void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
         {
+            flush();
             _rotate_xy(&x0, &y0);
             _rotate_xy(&x1, &y1);
             _gfx->drawLine(_x + x0, _y + y0,
@@ -73,6 +145,7 @@ class WindowGFX : public Adafruit_GFX {
         {
             int16_t nw, nh;
 
+            flush();
             _rotate_xy(&x, &y);
             _rotate_wh(&nw, &nh, h, h);
 
@@ -86,6 +159,7 @@ class WindowGFX : public Adafruit_GFX {
         {
             int16_t nw, nh;
 
+            flush();
             _rotate_xy(&x, &y);
             _rotate_wh(&nw, &nh, w, w);
 
@@ -97,6 +171,7 @@ class WindowGFX : public Adafruit_GFX {
 
         virtual void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
         {
+            flush();
             _rotate_xy(&x, &y);
             _rotate_wh(&w, &h);
 
@@ -105,6 +180,7 @@ class WindowGFX : public Adafruit_GFX {
 
         virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
         {
+            flush();
             _rotate_xy(&x, &y);
             _rotate_wh(&w, &h);
 
@@ -113,6 +189,7 @@ class WindowGFX : public Adafruit_GFX {
 
         virtual void fillScreen(uint16_t color)
         {
+            flush();
             _gfx->fillRect(_x, _y, _w, _h, color);
         }
 
@@ -122,6 +199,83 @@ class WindowGFX : public Adafruit_GFX {
         }
 
     private:
+        /* Is (ox, oy), relative to the rectangle origin, the next
+         * pixel of the pending rectangle? The second pixel sets the
+         * run direction, the first pixel beside the origin ends the
+         * first run and sets the run width.
+         */
+        bool _rect_next(int16_t ox, int16_t oy)
+        {
+            uint8_t col, row;
+
+            if (_rect.len == 1) {
+                if ((ox == 0 && (oy == 1 || oy == -1)) ||
+                    (oy == 0 && (ox == 1 || ox == -1))) {
+                    _rect.dx = ox;
+                    _rect.dy = oy;
+                    return true;
+                }
+                return false;
+            }
+
+            if (_rect.w == 0) {
+                if (ox == _rect.dx * _rect.len && oy == _rect.dy * _rect.len)
+                    return true;
+
+                if ((ox == _rect.dy && oy == _rect.dx) ||
+                    (ox == -_rect.dy && oy == -_rect.dx)) {
+                    _rect.sx = ox;
+                    _rect.sy = oy;
+                    _rect.w = _rect.len;
+                    return true;
+                }
+                return false;
+            }
+
+            col = _rect.len % _rect.w;
+            row = _rect.len / _rect.w;
+            return ox == _rect.dx * col + _rect.sx * row &&
+                   oy == _rect.dy * col + _rect.sy * row;
+        }
+
+        /* Write 'rows' runs of 'cols' pending pixels, starting at
+         * _rect.color[base], to the display through one address
+         * window. The window fills left to right, top to bottom,
+         * so each pixel is looked up from its offset along the
+         * run and stacking directions.
+         */
+        void _push(uint8_t base, int16_t x, int16_t y, uint8_t cols, uint8_t rows)
+        {
+            int16_t xe = x + _rect.dx * (cols - 1) + _rect.sx * (rows - 1);
+            int16_t ye = y + _rect.dy * (cols - 1) + _rect.sy * (rows - 1);
+            int16_t x0 = min(x, xe), x1 = max(x, xe);
+            int16_t y0 = min(y, ye), y1 = max(y, ye);
+
+            if (x0 < 0 || y0 < 0 ||
+                x1 >= _gfx->width() || y1 >= _gfx->height()) {
+                /* Off the display - let drawPixel() clip */
+                for (uint8_t row = 0; row < rows; row++) {
+                    for (uint8_t col = 0; col < cols; col++) {
+                        _gfx->drawPixel(x + _rect.dx * col + _rect.sx * row,
+                                        y + _rect.dy * col + _rect.sy * row,
+                                        _rect.color[base + row * cols + col]);
+                    }
+                }
+                return;
+            }
+
+            _gfx->setAddrWindow(x0, y0, x1, y1);
+            for (int16_t py = y0; py <= y1; py++) {
+                for (int16_t px = x0; px <= x1; px++) {
+                    int16_t ox = px - x, oy = py - y;
+                    uint8_t col = ox * _rect.dx + oy * _rect.dy;
+                    uint8_t row = ox * _rect.sx + oy * _rect.sy;
+
+                    _gfx->pushColor(_rect.color[base + row * cols + col]);
+                }
+            }
+        }
+
         void _rotate_xy(int16_t *x, int16_t *y, int16_t ox, int16_t oy)
         {
             int16_t nx = _x;
@@ -15,6 +15,11 @@
 #define ENABLE_AXIS_E           1
 #define ENABLE_TOOL_FUSER       1
 
+/* A second printhead (tool T2), on its own serial port */
+#ifndef ENABLE_INK_AUX
+#define ENABLE_INK_AUX          0
+#endif
+
 #define SERIAL_SPEED            115200
 
 #define X_MM_MAX                650.0
@@ -27,6 +32,94 @@
 #define Z_FEED_MAX              2000    /* mm/minute */
 #define E_FEED_MAX              2000    /* mm/minute */
 
+/* Homing: fast seek, slow re-approach (mm/minute), and backoff (mm) */
+#define X_HOME_FAST             1500
+#define X_HOME_SLOW             150
+#define X_HOME_BACKOFF          3.0
+
+#define Z_HOME_FAST             600
+#define Z_HOME_SLOW             60
+#define Z_HOME_BACKOFF          1.0
+
+#define E_HOME_FAST             600
+#define E_HOME_SLOW             60
+#define E_HOME_BACKOFF          1.0
+
+/* Closed loop DC encoder axes: PID period (usec), gains (PWM per
+ * count, per count-second, per count/second), feed-forward (PWM per
+ * count/second of planned velocity), the PWM below which the motor
+ * stalls, and the most PWM the integral may contribute.
+ */
+#define DCENC_PID_US            1000
+#define DCENC_KP                4.0
+#define DCENC_KI                40.0
+#define DCENC_KD                0.02
+#define DCENC_KFF               0.026
+#define DCENC_PWM_MIN           96
+#define DCENC_I_MAX             64
+
+/* Settled within this many counts for this many periods, and the
+ * following error (mm) that faults the axis.
+ */
+#define DCENC_SETTLE            1
+#define DCENC_SETTLE_TICKS      10
+#define DCENC_FOLLOW_MM         2.0
+
+/* Stepper encoder cross-check: the position error (mm) tolerated at
+ * the end of a segment. Beyond it, STEP_LOST_CORRECT makes up the
+ * lost steps, up to STEP_LOST_RETRY times per segment. Otherwise,
+ * or after that, the axis faults and the job is held until M17.
+ */
+#define STEP_LOST_MM            0.1
+#define STEP_LOST_CORRECT       1
+#define STEP_LOST_RETRY         3
+
+/* G2/G3 arcs: chord tolerance (mm), most chords per arc, and
+ * chords between exact corrections of the rotated radius.
+ */
+#define ARC_CHORD_MM            0.05
+#define ARC_SEGMENTS_MAX        2000
+#define ARC_CORRECTION          16
+
+/* M640 layer cycle defaults: layer height (mm), powder feed
+ * ratio (E raise per mm of Z drop), recoat feed (mm/minute),
+ * fuse pass time (ms, 0 for no fusing), and X travel extents (mm).
+ */
+#define LAYER_HEIGHT_MM         0.2
+#define LAYER_FEED_RATIO        1.5
+#define LAYER_RECOAT_FEED       2000
+#define LAYER_FUSE_MS           0
+#define LAYER_X_START           0
+#define LAYER_X_END             300
+
+/* M640: clip the fuse and recoat passes to the inked X extents
+ * plus this margin (mm). Negative to always sweep the full travel.
+ */
+#define LAYER_INK_MARGIN        -1
+
+/* Ink head nozzle row, spread along X */
+#define INK_NOZZLES             12
+#define INK_NOZZLE_MM           (25.4 / 96.0)
+
+/* Toolpath preview: time slice per loop, and the fewest queued
+ * G-code blocks that still leave slack for drawing while moving.
+ */
+#define VIS_SLICE_US            2000
+#define VIS_QUEUE_MIN           2
+
+/* Step event trace ring, dumped by M470. The simulator builds
+ * always enable it.
+ */
+#ifndef ENABLE_TRACE
+#define ENABLE_TRACE            0
+#endif
+#define TRACE_MAX               32
+
+/* Per-subsystem loop time accounting, reported by M472 */
+#ifndef ENABLE_PROFILE
+#define ENABLE_PROFILE          0
+#endif
+
 #define ARRAY_SIZE(x)           (sizeof(x)/sizeof((x)[0]))
 
 #endif /* CONFIG_H */
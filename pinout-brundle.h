@@ -31,21 +31,39 @@
 
 #define SD_CS                   53      /* D53 aka SS_PIN */
 
+/* Any axis may have a quadrature encoder, on <axis>_ENC_A and
+ * <axis>_ENC_B (define both to fit one). Stepper axes cross-check
+ * their step count against it.
+ */
+
 #define X_STP_MIN               35      /* Endstop (minimum) */
 #define X_STP_MAX               33      /* Endstop (maximum) */
 #define X_TURN_STEPS            200     /* Steps/full rotation */
 #define X_TURN_MM               33.0    /* mm/full rotation */
+#define X_ENC_COUNTS            400     /* Encoder counts/full rotation */
+/* X may instead be a DC gearmotor, closed loop on its encoder.
+ * Define X_ENC_MOTOR as its port (1 = M1) as well to select it.
+ */
+#ifdef X_ENC_MOTOR
+#define X_MOTOR(name)           Axis_DCEncoder name(X_ENC_MOTOR, X_ENC_A, X_ENC_B, \
+                                               X_STP_MIN, X_STP_MAX, \
+                                               X_FEED_MAX, X_MM_MAX, \
+                                               X_ENC_COUNTS, X_TURN_MM)
+#else
 #define X_MOTOR(name)           Axis_AF1Stepper name(2, X_STP_MIN, X_STP_MAX, \
                                                X_FEED_MAX, X_MM_MAX, \
                                                X_TURN_STEPS, X_TURN_MM)
+#endif
 
 /* Y is driven by the inkbar  - 8.75", 96 DPI */
 #define Y_MOTOR(name)           InkBar name(&Serial3,  0, 8.75 * 25.4, 96.0 / 25.4)
+#define Y_MOTOR_AUX(name)       InkBar name(&Serial2,  0, 8.75 * 25.4, 96.0 / 25.4)
 
 #define Z_STP_MIN               -1      /* Endstop (Minimim) */
 #define Z_STP_MAX               39      /* Endstop (Maximim) */
 #define Z_TURN_STEPS            200     /* Steps/full rotation */
 #define Z_TURN_MM               2.0     /* mm/full rotataton */
+#define Z_ENC_COUNTS            400     /* Encoder counts/full rotation */
 #define Z_MOTOR(name)           Axis_AF2Stepper name(2, Z_STP_MIN, Z_STP_MAX, \
                                                 Z_FEED_MAX, Z_MM_MAX, \
                                                 Z_TURN_STEPS, Z_TURN_MM)
@@ -54,6 +72,7 @@
 #define E_STP_MAX                -1      /* Endstop (Maximim) */
 #define E_TURN_STEPS            200     /* Steps/full rotation */
 #define E_TURN_MM               2.0     /* mm/full rotataton */
+#define E_ENC_COUNTS            400     /* Encoder counts/full rotation */
 #define E_MOTOR(name)           Axis_AF2Stepper name(1, E_STP_MIN, E_STP_MAX, \
                                                 E_FEED_MAX, E_MM_MAX, \
                                                 E_TURN_STEPS, E_TURN_MM)
@@ -45,6 +45,7 @@
 /* Y is driven by the inkbar - 9", 96 DPI */
 #define Y_DPMM                  (96.0 / 25.4)
 #define Y_MOTOR(name)           InkBar name(&Serial2,  0, Y_MM_MAX, Y_DPMM)
+#define Y_MOTOR_AUX(name)       InkBar name(&Serial3,  0, Y_MM_MAX, Y_DPMM)
 
 #define Z_STEP                  46
 #define Z_DIR                   48
@@ -29,6 +29,7 @@
 #endif
 
 #define TOOL_INK_BLACK          1
+#define TOOL_INK_AUX            2
 #define TOOL_FUSER              20
 #define TOOL_RECOAT             21
 #define TOOL_BED_TEMP           22
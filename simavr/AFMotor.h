@@ -5,7 +5,9 @@
 #ifndef _AFMotor_h_
 #define _AFMotor_h_
 
+#include "Arduino.h"
 #include "Encoder.h"
+#include "pinout.h"
 
     //#define MOTORDEBUG 1
 
@@ -63,10 +65,11 @@ class AF_DCMotor
 {
  public:
   AF_DCMotor(uint8_t motornum, uint8_t freq = DC_MOTOR_PWM_RATE) {
-#ifdef X_ENC_A
-    if (motornum == 0) {
+#ifdef X_ENC_MOTOR
+    if (motornum == X_ENC_MOTOR) {
       _encoder = X_ENC_A;
-      encoder_pinstop(_encoder, 11500, X_STP_MIN, X_STP_MAX);
+      encoder_pinstop(_encoder, SIM_TRAVEL(X_MM_MAX, X_ENC_COUNTS, X_TURN_MM),
+                      X_STP_MIN, X_STP_MAX);
     } else {
       _encoder = 0;
     }
@@ -90,11 +93,63 @@ class AF_DCMotor
 
 class AF_Stepper {
  public:
-  AF_Stepper(uint16_t, uint8_t) {}
-  void step(uint16_t steps, uint8_t dir,  uint8_t style = SINGLE) {}
+  AF_Stepper(uint16_t, uint8_t num)
+  {
+    steppingcounter = 0;
+    _pinStopMin = -1;
+    _pinStopMax = -1;
+    _limit = UINT32_MAX / 2;   /* No hard stops unless modelled */
+    _encMicrosteps = 0;
+#ifdef X_STP_MIN
+    if (num == 2) {
+      _pinStopMin = X_STP_MIN;
+      _pinStopMax = X_STP_MAX;
+      _limit = SIM_TRAVEL(X_MM_MAX, X_TURN_STEPS * MICROSTEPS / 4, X_TURN_MM);
+#if defined(X_ENC_A) && !defined(X_ENC_MOTOR)
+      /* Driven in DOUBLE steps, half of X_TURN_STEPS per rotation */
+      _encoder = X_ENC_A;
+      _encCounts = X_ENC_COUNTS;
+      _encMicrosteps = X_TURN_STEPS * MICROSTEPS / 4;
+#endif
+    }
+#endif
+  }
+  void step(uint16_t steps, uint8_t dir,  uint8_t style = SINGLE)
+  {
+    uint32_t from = steppingcounter;
+
+    if (!simavr_step())
+      return;
+
+    switch (style) {
+    case SINGLE: steps *= MICROSTEPS; break;
+    case DOUBLE: steps *= MICROSTEPS/2; break;
+    default: break;
+    }
+
+    if (dir == FORWARD) {
+      if (steppingcounter + steps >= _limit)
+        steppingcounter = _limit;
+      else
+        steppingcounter += steps;
+    } else if (dir == BACKWARD) {
+      if (steppingcounter < steps)
+        steppingcounter = 0;
+      else
+        steppingcounter -= steps;
+    }
+
+    digitalWrite(_pinStopMin, (steppingcounter == 0) ? 1 : 0);
+    digitalWrite(_pinStopMax, (steppingcounter == _limit) ? 1 : 0);
+
+    if (_encMicrosteps > 0)
+      encoder_step(_encoder, ((int32_t)steppingcounter - (int32_t)from) *
+                             _encCounts / _encMicrosteps);
+  }
   void setSpeed(uint16_t) {}
   uint8_t onestep(uint8_t dir, uint8_t style)
-  { return (style == SINGLE) ? MICROSTEPS : 
+  { step(1, dir, style);
+    return (style == SINGLE) ? MICROSTEPS : 
            (style == DOUBLE) ? MICROSTEPS/2 :
            1;
   }
@@ -104,7 +159,11 @@ class AF_Stepper {
   uint32_t usperstep, steppingcounter;
  private:
   uint8_t currentstep;
-
+  int _pinStopMin;
+  int _pinStopMax;
+  uint32_t _limit;
+  int _encoder;
+  int32_t _encCounts, _encMicrosteps;   /* Per rotation */
 };
 
 #endif
@@ -57,6 +57,11 @@ class Adafruit_StepperMotor {
 
   void step(uint16_t steps, uint8_t dir,  uint8_t style = SINGLE)
   {
+    uint32_t from = steppingcounter;
+
+    if (!simavr_step())
+      return;
+
     switch (style) {
     case SINGLE: steps *= MICROSTEPS; break;
     case DOUBLE: steps *= MICROSTEPS/2; break;
@@ -78,11 +83,16 @@ class Adafruit_StepperMotor {
     digitalWrite(_pinStopMin, (steppingcounter == 0) ? 1 : 0);
 
     digitalWrite(_pinStopMax, (steppingcounter == _limit) ? 1 : 0);
+
+    if (_encMicrosteps > 0)
+      encoder_step(_encoder, ((int32_t)steppingcounter - (int32_t)from) *
+                             _encCounts / _encMicrosteps);
   }
 
   void setSpeed(uint16_t) {}
   uint8_t onestep(uint8_t dir, uint8_t style)
-  { return (style == SINGLE) ? MICROSTEPS : 
+  { step(1, dir, style);
+    return (style == SINGLE) ? MICROSTEPS : 
            (style == DOUBLE) ? MICROSTEPS/2 :
            1;
   }
@@ -93,6 +103,8 @@ class Adafruit_StepperMotor {
     int _pinStopMin;
     int _pinStopMax;
     uint32_t _limit;
+    int _encoder;
+    int32_t _encCounts, _encMicrosteps;   /* Per rotation */
 };
 
 class Adafruit_MotorShield
@@ -116,15 +128,28 @@ public:
         return NULL;
       st = &steppers[n-1];
 
+      /* Driven in DOUBLE steps, half of TURN_STEPS per rotation.
+       * No encoder unless set here - AFMS is static, so zeroed.
+       */
       if (n == 2) {
         st->_pinStopMin = -1;
         st->_pinStopMax = Z_STP_MAX;
-        st->_limit = 11500 * MICROSTEPS;
+        st->_limit = SIM_TRAVEL(Z_MM_MAX, Z_TURN_STEPS * MICROSTEPS / 4, Z_TURN_MM);
+#ifdef Z_ENC_A
+        st->_encoder = Z_ENC_A;
+        st->_encCounts = Z_ENC_COUNTS;
+        st->_encMicrosteps = Z_TURN_STEPS * MICROSTEPS / 4;
+#endif
       }
       if (n == 1) {
         st->_pinStopMin = E_STP_MIN;
         st->_pinStopMax = -1;
-        st->_limit = 11500 * MICROSTEPS;
+        st->_limit = SIM_TRAVEL(E_MM_MAX, E_TURN_STEPS * MICROSTEPS / 4, E_TURN_MM);
+#ifdef E_ENC_A
+        st->_encoder = E_ENC_A;
+        st->_encCounts = E_ENC_COUNTS;
+        st->_encMicrosteps = E_TURN_STEPS * MICROSTEPS / 4;
+#endif
       }
       return st;
     }
@@ -20,8 +20,6 @@
 
 #include <Adafruit_GFX.h>
 
-#include <SDL.h>
-
 #include "main.h"
 
 // some flags for initR() :(
@@ -50,10 +48,74 @@
 #define ST7735_YELLOW  0xFFE0  
 #define ST7735_WHITE   0xFFFF
 
+#ifdef SIMAVR_HEADLESS
+/* Headless display - draws into a framebuffer that nobody looks at */
+class Adafruit_ST7735 : public Adafruit_GFX {
+    private:
+        uint16_t _fb[ST7735_TFTHEIGHT_18][ST7735_TFTWIDTH];
+        struct {
+            int16_t x0, y0, x1, y1;
+            int16_t x, y;
+        } _window;
+
+    public:
+        Adafruit_ST7735(int pin_cs, int pin_dc, int pin_rst)
+            : Adafruit_GFX(ST7735_TFTWIDTH, ST7735_TFTHEIGHT_18)
+        {
+            /* No window open */
+            _window.y = 0;
+            _window.y1 = -1;
+        }
+
+        void initR(uint8_t options = INITR_GREENTAB)
+        {
+            fillRect(0, 0, WIDTH, HEIGHT, ST7735_WHITE);
+        }
+
+        void drawPixel(int16_t x, int16_t y, uint16_t color)
+        {
+            if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT)
+                return;
+
+            _fb[y][x] = color;
+        }
+
+        void setAddrWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+        {
+            _window.x0 = x0;
+            _window.y0 = y0;
+            _window.x1 = x1;
+            _window.y1 = y1;
+            _window.x = x0;
+            _window.y = y0;
+        }
+
+        void pushColor(uint16_t color)
+        {
+            if (_window.y > _window.y1)
+                return;
+
+            drawPixel(_window.x, _window.y, color);
+
+            if (_window.x++ < _window.x1)
+                return;
+
+            _window.x = _window.x0;
+            _window.y++;
+        }
+};
+#else
+#include <SDL.h>
+
 class Adafruit_ST7735 : public Adafruit_GFX {
     private:
         SDL_Surface *_surface;
         int _lock;
+        struct {
+            bool open;
+            int16_t x0, y0, x1, y1;
+            int16_t x, y;
+        } _window;
 
         void _pixel_lock()
         {
@@ -69,11 +131,34 @@ class Adafruit_ST7735 : public Adafruit_GFX {
             }
         }
 
+        Uint32 _pixel_map(uint16_t color)
+        {
+            return SDL_MapRGB(_surface->format,
+                    ((color >> 11) << 3) & 0xff,
+                    ((color >>  5) << 2) & 0xff,
+                    ((color >>  0) << 3) & 0xff);
+        }
+
+        /* Caller must hold the surface lock */
+        void _pixel_put(int16_t x, int16_t y, Uint32 pixel)
+        {
+            if (x < 0 || x >= WIDTH || y <0 || y >= HEIGHT)
+                return;
+
+            x *= 2;
+            y *= 2;
+            ((Uint32 *)_surface->pixels)[y * _surface->w + x] = pixel;
+            ((Uint32 *)_surface->pixels)[y * _surface->w + x + 1] = pixel;
+            ((Uint32 *)_surface->pixels)[(y + 1) * _surface->w + x] = pixel;
+            ((Uint32 *)_surface->pixels)[(y + 1)* _surface->w + x + 1] = pixel;
+        }
+
     public:
         Adafruit_ST7735(int pin_cs, int pin_dc, int pin_rst)
             : Adafruit_GFX(ST7735_TFTWIDTH, ST7735_TFTHEIGHT_18)
         {
             _lock = 0;
+            _window.open = false;
         }
         ~Adafruit_ST7735()
         {
@@ -91,22 +176,45 @@ class Adafruit_ST7735 : public Adafruit_GFX {
 
         void drawPixel(int16_t x, int16_t y, uint16_t color)
         {
-            Uint32 pixel;
-            if (x < 0 || x >= WIDTH || y <0 || y >= HEIGHT)
-                return;
-            
-            pixel = SDL_MapRGB(_surface->format, 
-                    ((color >> 11) << 3) & 0xff,
-                    ((color >>  5) << 2) & 0xff,
-                    ((color >>  0) << 3) & 0xff);
+            _pixel_lock();
+            _pixel_put(x, y, _pixel_map(color));
+            _pixel_unlock();
+        }
 
-            x *= 2;
-            y *= 2;
+        /* The surface stays locked from setAddrWindow() until
+         * the last pixel of the window has been pushed, so a
+         * whole window is a single blit.
+         */
+        void setAddrWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+        {
+            if (_window.open)
+                _pixel_unlock();
+
+            _window.open = true;
+            _window.x0 = x0;
+            _window.y0 = y0;
+            _window.x1 = x1;
+            _window.y1 = y1;
+            _window.x = x0;
+            _window.y = y0;
             _pixel_lock();
-            ((Uint32 *)_surface->pixels)[y * _surface->w + x] = pixel;
-            ((Uint32 *)_surface->pixels)[y * _surface->w + x + 1] = pixel;
-            ((Uint32 *)_surface->pixels)[(y + 1) * _surface->w + x] = pixel;
-            ((Uint32 *)_surface->pixels)[(y + 1)* _surface->w + x + 1] = pixel;
+        }
+
+        void pushColor(uint16_t color)
+        {
+            if (!_window.open)
+                return;
+
+            _pixel_put(_window.x, _window.y, _pixel_map(color));
+
+            if (_window.x++ < _window.x1)
+                return;
+
+            _window.x = _window.x0;
+            if (_window.y++ < _window.y1)
+                return;
+
+            _window.open = false;
             _pixel_unlock();
         }
 
@@ -150,10 +258,7 @@ class Adafruit_ST7735 : public Adafruit_GFX {
 
         void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
         {
-            Uint32 pixel = SDL_MapRGB(_surface->format, 
-                    ((color >> 11) << 3) & 0xff,
-                    ((color >>  5) << 2) & 0xff,
-                    ((color >>  0) << 3) & 0xff);
+            Uint32 pixel = _pixel_map(color);
             SDL_Rect r;
 
             r.x = x * 2;
@@ -165,6 +270,7 @@ class Adafruit_ST7735 : public Adafruit_GFX {
             _pixel_unlock();
         }
 };
+#endif /* SIMAVR_HEADLESS */
 
 #endif /* SIMAVR_ADAFRUIT_ST7735_H */
 /* vim: set shiftwidth=4 expandtab:  */
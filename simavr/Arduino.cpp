@@ -18,9 +18,14 @@
 #include <sys/time.h>
 
 #include "Arduino.h"
+#include "main.h"
 
 static int digitalPin[54];
 static int analogPin[6];
+static struct {
+    void (*isr)(void);
+    int mode;
+} digitalIrq[54];
 
 long map(long x, long in_min, long in_max, long out_min, long out_max)
 {
@@ -35,9 +40,41 @@ void pinMode(uint8_t pin, uint8_t mode)
 
 void digitalWrite(uint8_t pin, uint8_t value)
 {
+    int old;
+
     if (pin >= 54)
         return;
+
+    old = digitalPin[pin];
     digitalPin[pin] = value;
+
+    if (old != value)
+        simavr_pin_activity();
+
+    if (digitalIrq[pin].isr && old != value) {
+        int mode = digitalIrq[pin].mode;
+        if (mode == CHANGE ||
+            (mode == RISING && value) ||
+            (mode == FALLING && !value))
+            digitalIrq[pin].isr();
+    }
+}
+
+void attachInterrupt(uint8_t irq, void (*isr)(void), int mode)
+{
+    if (irq >= 54)
+        return;
+
+    digitalIrq[irq].isr = isr;
+    digitalIrq[irq].mode = mode;
+}
+
+void detachInterrupt(uint8_t irq)
+{
+    if (irq >= 54)
+        return;
+
+    digitalIrq[irq].isr = NULL;
 }
 
 int digitalRead(uint8_t pin)
@@ -63,6 +100,27 @@ void analogWrite(uint8_t pin, int val)
     analogPin[pin] = val;
 }
 
+#ifdef SIMAVR_HEADLESS
+/* Virtual clock. Every read costs a little time, so that
+ * busy-waits on the clock still terminate.
+ */
+unsigned long micros(void)
+{
+    _micros += SIMAVR_CLOCK_READ_US;
+
+    return _micros;
+}
+
+unsigned long millis(void)
+{
+    return micros() / 1000;
+}
+
+unsigned long simavr_now(void)
+{
+    return _micros;
+}
+#else
 unsigned long micros(void)
 {
     struct timeval tv;
@@ -81,6 +139,12 @@ unsigned long millis(void)
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+unsigned long simavr_now(void)
+{
+    return micros();
+}
+#endif
+
 char * ltoa (long val, char *s, int radix)
 {
     if (radix == 8)
@@ -57,6 +57,9 @@ extern "C"{
 #define degrees(rad) ((rad)*RAD_TO_DEG)
 #define sq(x) ((x)*(x))
 
+static inline void sei(void) { }
+static inline void cli(void) { }
+
 #define interrupts() sei()
 #define noInterrupts() cli()
 
@@ -98,6 +101,10 @@ unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
 void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val);
 uint8_t shiftIn(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder);
 
+/* The simulator has a 'change' interrupt on every digital pin */
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) < 54 ? (p) : NOT_AN_INTERRUPT)
+
 void attachInterrupt(uint8_t, void (*)(void), int mode);
 void detachInterrupt(uint8_t);
 
@@ -207,6 +214,14 @@ static const uint8_t A14 = 68;
 static const uint8_t A15 = 69;
 
 #ifdef __cplusplus
+// Simulator hooks - see simavr/main.cpp
+void simavr_deadline(unsigned long us);
+void simavr_activity(void);
+void simavr_pin_activity(void);
+bool simavr_step(void);
+void simavr_poll(void);
+void simavr_trace(uint8_t axis, int dir, unsigned long due, unsigned long at);
+
 #include "WCharacter.h"
 #include "WString.h"
 #include "HardwareSerial.h"
@@ -21,7 +21,7 @@
 
 #include "Encoder.h"
 
-#define SPEED_SCALE     1.7f
+#define SPEED_SCALE     0.002f  /* counts/usec, at half speed */
 
 static struct encoder {
     unsigned long time;
@@ -106,6 +106,12 @@ void encoder_speed(int n, float speed)
     _encoder[n].time = now;
 }
 
+/* Encoder on a stepper, moved by the steps actually taken */
+void encoder_step(int n, int32_t counts)
+{
+    _encoder[n].position += counts;
+}
+
 void encoder_dir(int n, uint8_t dir)
 {
     unsigned long now = micros();
@@ -8,11 +8,20 @@
 #define BRAKE 3
 #define RELEASE 4
 
+/* Modelled travel of an axis of mm_max, in the units (microsteps or
+ * encoder counts) the shim counts, at per_turn units per turn_mm.
+ * The hard stops sit SIM_OVERTRAVEL_MM past the soft limit.
+ */
+#define SIM_OVERTRAVEL_MM 5.0
+#define SIM_TRAVEL(mm_max, per_turn, turn_mm) \
+	((uint32_t)(((mm_max) + SIM_OVERTRAVEL_MM) * (per_turn) / (turn_mm)))
+
 void encoder_pinstop(int n, uint32_t range, int pin_min, int pin_max);
 void encoder_speed(int encoder, float speed);
 void encoder_dir(int encoder, uint8_t dir);
 void encoder_reset(int n);
 void encoder_set(int n, int32_t pos);
+void encoder_step(int n, int32_t counts);
 int32_t encoder_get(int n);
 
 class Encoder
@@ -33,20 +33,38 @@
 class HardwareSerial : public Stream
 {
   private:
-    int _io;
+    int _io, _out;
     int _c;
+    bool _eof, _attached;
     struct termios _term;
     const char *_device;
   public:
     HardwareSerial(const char *device = "/dev/tty")
     {
       _io = -1;
+      _out = -1;
       _c = -1;
+      _eof = false;
+      _attached = false;
       _device = device;
     }
+    // Use already open descriptors, rather than the device
+    void attach(int in, int out)
+    {
+      _io = in;
+      _out = out;
+      _attached = true;
+    }
     void begin(unsigned long baud_rate, uint8_t unit = 0)
     {
+      _c = -1;
+      _eof = false;
+
+      if (_attached)
+        return;
+
       _io = ::open(_device, O_RDWR | O_NONBLOCK);
+      _out = _io;
       if (_io >= 0) {
         struct termios nterm;
         ::tcgetattr(_io, &_term);
@@ -54,16 +72,20 @@ class HardwareSerial : public Stream
         ::cfmakeraw(&nterm);
         ::tcsetattr(_io, TCSANOW, &nterm);
       }
-
-      _c = -1;
     }
     void end()
     {
-      if (_io >= 0) {
+      if (_io >= 0 && !_attached) {
         ::tcsetattr(_io, TCSANOW, &_term);
         ::close(_io);
       }
       _io = -1;
+      _out = -1;
+    }
+    // True once the input has reached end of file
+    bool eof(void)
+    {
+      return _eof && _c < 0;
     }
     virtual int available(void)
     {
@@ -73,11 +95,19 @@ class HardwareSerial : public Stream
       if (_c >= 0)
         return true;
 
+      if (_io < 0 || _eof)
+        return false;
+
+      simavr_poll();
+
       err = ::read(_io, &c, 1);
-      if (err < 0)
+      if (err == 0)
+        _eof = true;
+      if (err <= 0)
         return false;
 
-      _c = c;
+      simavr_activity();
+      _c = (uint8_t)c;
       return true;
     }
     virtual int peek(void)
@@ -99,7 +129,14 @@ class HardwareSerial : public Stream
     virtual void flush(void) { }
     virtual size_t write(uint8_t c)
     {
-      return ::write(_io, &c, 1);
+      int err;
+
+      err = ::write(_out, &c, 1);
+      if (err <= 0)
+        return 0;
+
+      simavr_activity();
+      return err;
     }
     inline size_t write(unsigned long n) { return write((uint8_t)n); }
     inline size_t write(long n) { return write((uint8_t)n); }
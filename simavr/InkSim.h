@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef SIMAVR_INKSIM_H
+#define SIMAVR_INKSIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include <HardwareSerial.h>
+
+#include "config.h"
+#include "BrundleInk.h"
+#include "timecmp.h"
+#include "main.h"
+
+/* Serial time per byte, at 115200 n81 */
+#define INKSIM_BYTE_US          87
+
+/* Carriage time per dotline, plus per spray on non-blank dotlines */
+#define INKSIM_STEP_US          200
+#define INKSIM_SPRAY_US         500
+
+#define INKSIM_DOTLINES         1024    /* Dotline buffer */
+#define INKSIM_KELVIN           2981    /* 0.1K, room temperature */
+
+/* BrundleInk printhead emulator, for the simulator.
+ *
+ * Speaks the printhead's line protocol on one end of a socket
+ * pair, the other end being a HardwareSerial:
+ *
+ *   nN  Set the line number        lP  Queue a dotline of pattern P
+ *   ?   Report status              rN  Repeat the last dotline N times
+ *   h   Home the carriage          sN  Set N+1 sprays per dotline
+ *   i   Ink the queue, forwards    k   Clear the dotline queue
+ *   j   Ink the queue, in reverse
+ *
+ * Replies are delayed by their serial time, plus any extra
+ * latency. The carriage moves, and sprays, in simulated time.
+ * With error injection on, replies are dropped or corrupted
+ * at random, and the firmware has to resend.
+ *
+ * Like the hardware, the emulator cannot tell a resent command
+ * from a new one, so it applies it again. A lost reply also
+ * leaves the head's line number ahead of the firmware's, and
+ * the firmware then rejects every status reply until the next
+ * 'n'. Both are counted, and shown in the exit report.
+ */
+class InkSim {
+    private:
+        int _fd;
+        uint16_t _line;
+        uint8_t _sprays;
+        unsigned long _latency;         /* Extra usec per reply */
+        unsigned _error_rate;           /* 1 in N replies, 0 for none */
+        uint32_t _seed;
+        bool _resend;                   /* Next command is a resend */
+        int _desync;                    /* Head line - firmware line */
+
+        struct {
+            char buff[32];
+            int pos;
+        } _rx;
+
+        struct {
+            char buff[48];
+            unsigned long ready;        /* When the reply is sent */
+            bool pending;
+        } _tx;
+
+        struct {
+            uint16_t pattern[INKSIM_DOTLINES];
+            int count;
+        } _queue;
+
+        struct {
+            bool on, ink;
+            int pos;                    /* Current dotline */
+            int target;
+            unsigned long next;         /* Time of the next dotline */
+        } _motor;
+
+        struct {
+            unsigned long commands;
+            unsigned long dotlines;
+            unsigned long sprays;
+            unsigned long errors;
+            unsigned long repeats;      /* Resent commands, applied twice */
+            unsigned long extra;        /* ..and the dotlines they added */
+            unsigned long rejected;     /* Status replies while desynced */
+        } _stats;
+
+        uint32_t _random()
+        {
+            _seed = _seed * 1103515245 + 12345;
+            return _seed >> 16;
+        }
+
+        unsigned long _dotline_us(int pos)
+        {
+            unsigned long us = INKSIM_STEP_US;
+
+            if (_motor.ink && pos < _queue.count && _queue.pattern[pos])
+                us += _sprays * INKSIM_SPRAY_US;
+
+            return us;
+        }
+
+        void _move(int target, bool ink, unsigned long now)
+        {
+            _motor.target = target;
+            _motor.ink = ink;
+            _motor.on = (_motor.pos != target);
+            _motor.next = now + _dotline_us(_motor.pos);
+        }
+
+        /* Advance the carriage, spraying as it goes */
+        void _motor_update(unsigned long now)
+        {
+            while (_motor.on && !time_before(now, _motor.next)) {
+                int pos = _motor.pos;
+
+                if (_motor.ink && pos < _queue.count && _queue.pattern[pos]) {
+                    _stats.dotlines++;
+                    _stats.sprays += _sprays;
+                }
+
+                _motor.pos += (_motor.target > pos) ? 1 : -1;
+                if (_motor.pos == _motor.target)
+                    _motor.on = false;
+                else
+                    _motor.next += _dotline_us(_motor.pos);
+            }
+
+            if (_motor.on)
+                simavr_deadline(_motor.next);
+        }
+
+        uint8_t _state()
+        {
+            uint8_t s = 0;
+
+            if (_motor.on)
+                s |= STATUS_MOTOR_ON;
+            if (_motor.pos == 0)
+                s |= STATUS_MOTOR_MIN;
+            if (_motor.pos >= INKSIM_DOTLINES - 1)
+                s |= STATUS_MOTOR_MAX;
+            if (_motor.on && _motor.ink)
+                s |= STATUS_INK_ON;
+
+            return s;
+        }
+
+        void _command(char cmd, uint16_t val, unsigned long now)
+        {
+            int queued = _queue.count;
+
+            _stats.commands++;
+
+            switch (cmd) {
+            case 'n':
+                _line = val;
+                _desync = 0;
+                break;
+            case 'h':
+                _move(0, false, now);
+                break;
+            case 'i':
+                _move(_queue.count, true, now);
+                break;
+            case 'j':
+                _move(0, true, now);
+                break;
+            case 'k':
+                _queue.count = 0;
+                break;
+            case 'l':
+                if (_queue.count < INKSIM_DOTLINES)
+                    _queue.pattern[_queue.count++] = val;
+                break;
+            case 'r':
+                while (val-- > 0 && _queue.count > 0 &&
+                       _queue.count < INKSIM_DOTLINES) {
+                    _queue.pattern[_queue.count] = _queue.pattern[_queue.count - 1];
+                    _queue.count++;
+                }
+                break;
+            case 's':
+                _sprays = val + 1;
+                break;
+            default:
+                break;
+            }
+
+            if (cmd == '?')
+                snprintf(_tx.buff, sizeof(_tx.buff), "ok %x %x %x %x %x %x\n",
+                         _state(), _sprays, INKSIM_DOTLINES - _queue.count,
+                         _line, _motor.pos, INKSIM_KELVIN);
+            else
+                snprintf(_tx.buff, sizeof(_tx.buff), "ok\n");
+
+            _line = (_line + 1) & 0xfff;
+
+            if (_resend) {
+                _stats.repeats++;
+                if (cmd == 'l' || cmd == 'r')
+                    _stats.extra += _queue.count - queued;
+                _resend = false;
+            }
+
+            _tx.ready = now + _latency +
+                        (strlen(_rx.buff) + 2 + strlen(_tx.buff)) * INKSIM_BYTE_US;
+            _tx.pending = true;
+
+            /* Drop the reply, or garble it. The firmware resends
+             * either way, but only counts the line number of a
+             * reply it has parsed.
+             */
+            if (_error_rate && (_random() % _error_rate) == 0) {
+                _stats.errors++;
+                _resend = true;
+                if (_random() & 1) {
+                    _tx.pending = false;
+                    _desync++;
+                } else {
+                    _tx.buff[_random() % 2] = '#';
+                    if (cmd == '?')
+                        _desync++;
+                }
+            } else if (cmd == '?' && _desync) {
+                _stats.rejected++;
+            }
+        }
+
+    public:
+        InkSim()
+        {
+            _fd = -1;
+            _latency = 0;
+            _error_rate = 0;
+        }
+
+        void begin(int fd)
+        {
+            _fd = fd;
+            _line = 0;
+            _sprays = 4;
+            _seed = 1;
+            _resend = false;
+            _desync = 0;
+            _rx.pos = 0;
+            _tx.pending = false;
+            _queue.count = 0;
+            _motor.on = false;
+            _motor.pos = INKSIM_DOTLINES / 2;
+            memset(&_stats, 0, sizeof(_stats));
+        }
+
+        void latency_set(unsigned long us)
+        {
+            _latency = us;
+        }
+
+        /* Drop or corrupt 1 in 'rate' replies */
+        void error_set(unsigned rate)
+        {
+            _error_rate = rate;
+        }
+
+        void update()
+        {
+            unsigned long now = simavr_now();
+            char c;
+
+            if (_fd < 0)
+                return;
+
+            _motor_update(now);
+
+            if (_tx.pending) {
+                if (time_before(now, _tx.ready)) {
+                    simavr_deadline(_tx.ready);
+                    return;
+                }
+                if (::write(_fd, _tx.buff, strlen(_tx.buff)) < 0)
+                    perror("inksim");
+                _tx.pending = false;
+            }
+
+            /* One command at a time, like the real thing */
+            while (!_tx.pending && ::read(_fd, &c, 1) == 1) {
+                if (c == '\r')
+                    continue;
+
+                if (c != '\n') {
+                    if (_rx.pos < (int)sizeof(_rx.buff) - 1)
+                        _rx.buff[_rx.pos++] = c;
+                    continue;
+                }
+
+                _rx.buff[_rx.pos] = 0;
+                _rx.pos = 0;
+
+                if (_rx.buff[0])
+                    _command(_rx.buff[0], strtoul(&_rx.buff[1], NULL, 16), now);
+            }
+
+            if (_tx.pending)
+                simavr_deadline(_tx.ready);
+        }
+
+        void report(FILE *f, const char *name)
+        {
+            if (_fd < 0)
+                return;
+
+            fprintf(f, "%s: %lu commands, %lu dotlines, %lu sprays, %lu errors injected\n",
+                    name, _stats.commands, _stats.dotlines, _stats.sprays,
+                    _stats.errors);
+
+            if (_stats.errors)
+                fprintf(f, "%s: %lu commands applied twice (+%lu dotlines queued), "
+                           "%lu status replies rejected, line number %d ahead\n",
+                        name, _stats.repeats, _stats.extra,
+                        _stats.rejected, _desync);
+        }
+};
+
+#endif /* SIMAVR_INKSIM_H */
+/* vim: set shiftwidth=4 expandtab:  */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#ifndef SIMAVR_LAMPSIM_H
+#define SIMAVR_LAMPSIM_H
+
+#include <stdio.h>
+#include <math.h>
+
+#include "Arduino.h"
+
+#include "ToolFuser.h"
+#include "main.h"
+
+#define LAMPSIM_AMBIENT_C       25.0    /* Lamp off */
+#define LAMPSIM_HOT_C           300.0   /* Lamp left on forever */
+#define LAMPSIM_TAU_US          10000000.0      /* Time constant */
+
+/* Fuser lamp emulator, for the simulator.
+ *
+ * The lamp heats towards LAMPSIM_HOT_C while its enable pin is
+ * high, and cools towards ambient while it is low, as a first
+ * order system. The temperature is fed back to the fuser's ADC
+ * pin through the ToolFuser thermistor table.
+ */
+class LampSim {
+    private:
+        int _enable_pin;
+        int _adc_pin;
+        float _celsius;
+        float _peak;
+        unsigned long _last;
+        unsigned long _on_us;
+
+    public:
+        LampSim()
+        {
+            _enable_pin = -1;
+        }
+
+        void begin(int enable_pin, int adc_pin)
+        {
+            _enable_pin = enable_pin;
+            _adc_pin = adc_pin;
+            _celsius = LAMPSIM_AMBIENT_C;
+            _peak = _celsius;
+            _last = simavr_now();
+            _on_us = 0;
+            update();
+        }
+
+        void update()
+        {
+            unsigned long now = simavr_now();
+            unsigned long dt = now - _last;
+            bool on;
+            float target;
+
+            if (_enable_pin < 0)
+                return;
+
+            _last = now;
+            on = digitalRead(_enable_pin) == HIGH;
+            target = on ? LAMPSIM_HOT_C : LAMPSIM_AMBIENT_C;
+
+            _celsius += (target - _celsius) * (1.0 - exp(-(float)dt / LAMPSIM_TAU_US));
+            if (_celsius > _peak)
+                _peak = _celsius;
+            if (on)
+                _on_us += dt;
+
+            analogWrite(_adc_pin, adc());
+        }
+
+        /* Thermistor reading, interpolated from the fuser's table */
+        int adc()
+        {
+            short adc_lo = temptable[0].adc;
+            short c_lo = temptable[0].celsius;
+
+            for (int i = 1; i < NUMTEMPS; i++) {
+                short adc_hi = temptable[i].adc;
+                short c_hi = temptable[i].celsius;
+
+                if (_celsius < c_hi)
+                    return adc_lo + (_celsius - c_lo) * (adc_hi - adc_lo) / (c_hi - c_lo);
+
+                adc_lo = adc_hi;
+                c_lo = c_hi;
+            }
+
+            return adc_lo;
+        }
+
+        void report(FILE *f, const char *name)
+        {
+            if (_enable_pin < 0)
+                return;
+
+            fprintf(f, "%s: %lu.%03lu s on, %.0f C peak\n", name,
+                    _on_us / 1000000, (_on_us / 1000) % 1000, _peak);
+        }
+};
+
+#endif /* SIMAVR_LAMPSIM_H */
+/* vim: set shiftwidth=4 expandtab:  */
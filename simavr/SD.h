@@ -21,17 +21,72 @@
 #include <fcntl.h>
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #define SD_CHIP_SELECT_PIN      0
 
 #define FILE_READ O_RDONLY
 #define FILE_WRITE (O_RDWR | O_CREAT)
 
+// The SD root is the current directory
+static inline const char *sd_path(const char *name)
+{
+  while (name && name[0] == '/')
+    name++;
+  if (name && name[0] == 0)
+    name = ".";
+  return name;
+}
+
+// Read-only files are mapped whole. The mapping is shared by
+// copies of the File, as a FILE * would be.
+struct file_map {
+  const uint8_t *data;
+  uint32_t size;
+  uint32_t pos;
+};
+
 class File : public Stream {
  private:
   char *_name; // our name
   FILE *_file;
   DIR *_dir;
+  uint32_t _dirpos; // directory entries read so far
+  struct file_map *_map;
+
+  static struct file_map *_map_open(const char *name)
+  {
+    struct file_map *map;
+    struct stat st;
+    void *data = NULL;
+    int fd;
+
+    fd = ::open(name, O_RDONLY);
+    if (fd < 0)
+      return NULL;
+
+    if (fstat(fd, &st) < 0) {
+      ::close(fd);
+      return NULL;
+    }
+
+    if (st.st_size > 0) {
+      data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        return NULL;
+      }
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+
+    map = (struct file_map *)malloc(sizeof(*map));
+    map->data = (const uint8_t *)data;
+    map->size = st.st_size;
+    map->pos = 0;
+
+    return map;
+  }
 
 public:
   File(const char *name, uint8_t mode = O_RDONLY)
@@ -40,9 +95,9 @@ public:
     struct stat st;
     int err;
 
-    if (name && name[0] == 0)
-      name = ".";
+    name = sd_path(name);
 
+    _map = NULL;
     _name = name ? strdup(name) : NULL;
     if (_name == NULL) {
       _dir = NULL;
@@ -51,6 +106,10 @@ public:
     }
 
     err = stat(_name, &st);
+    if (err < 0 && (mode & O_CREAT)) {
+      st.st_mode = S_IFREG;
+      err = 0;
+    }
     if (err < 0) {
       free(_name);
       _name = NULL;
@@ -61,7 +120,12 @@ public:
 
     if (S_ISDIR(st.st_mode)) {
       _dir = opendir(_name);
+      _dirpos = 0;
+      _file = NULL;
+    } else if ((mode & O_ACCMODE) == O_RDONLY) {
+      _map = _map_open(_name);
       _file = NULL;
+      _dir  = NULL;
     } else {
       _file = fopen(_name, marg);
       _dir  = NULL;
@@ -76,60 +140,100 @@ public:
     _name = NULL;
     _file = NULL;
     _dir  = NULL;
+    _map  = NULL;
   }
   ~File(void)
   {
   }
   virtual size_t write(uint8_t c)
   {
+    if (!_file)
+      return 0;
     return fputc(c, _file);
   }
   virtual size_t write(const uint8_t *buf, size_t size)
   {
+    if (!_file)
+      return 0;
     return fwrite(buf, sizeof(uint8_t), size, _file);
   }
   virtual int read()
   {
+    simavr_activity();
+    if (_map)
+      return (_map->pos < _map->size) ? _map->data[_map->pos++] : -1;
     return fgetc(_file);
   }
   virtual int peek()
   {
+    if (_map)
+      return (_map->pos < _map->size) ? _map->data[_map->pos] : -1;
     int c = fgetc(_file);
     ungetc(c, _file);
     return c;
   }
   virtual int available()
   {
+    if (_map)
+      return _map->size - _map->pos;
     return _file ? !feof(_file) : 0;
   }
   virtual void flush()
   {
-    fflush(_file);
+    if (_file)
+      fflush(_file);
   }
   int read(void *buf, uint16_t nbyte)
   {
+    simavr_activity();
+    if (_map) {
+      uint32_t len = _map->size - _map->pos;
+      if (len > nbyte)
+        len = nbyte;
+      memcpy(buf, _map->data + _map->pos, len);
+      _map->pos += len;
+      return len;
+    }
     return fread(buf, sizeof(uint8_t), nbyte, _file);
   }
   boolean seek(uint32_t pos)
   {
     int err;
+    if (_dir) {
+      rewindDirectory();
+      while (_dirpos < pos && readdir(_dir))
+        _dirpos++;
+      return _dirpos == pos;
+    }
+    if (_map) {
+      if (pos > _map->size)
+        return false;
+      _map->pos = pos;
+      return true;
+    }
     err = fseek(_file, pos, SEEK_SET);
     return (err < 0) ? false : true;
   }
   uint32_t position()
   {
-    return ftell(_file);
+    if (_map)
+      return _map->pos;
+    return _dir ? _dirpos : ftell(_file);
   }
   uint32_t size()
   {
     struct stat st;
+    if (_map)
+      return _map->size;
     fstat(fileno(_file), &st);
     return st.st_size;
   }
   void close()
   {
-    if (_name)
+    if (_name) {
       free(_name);
+      _name = NULL;
+    }
     if (_file) {
       fclose(_file);
       _file = NULL;
@@ -138,10 +242,16 @@ public:
       closedir(_dir);
       _dir = NULL;
     }
+    if (_map) {
+      if (_map->data)
+        munmap((void *)_map->data, _map->size);
+      free(_map);
+      _map = NULL;
+    }
   }
   operator bool()
   {
-    return (_file == NULL && _dir == NULL) ? false : true;
+    return (_file == NULL && _dir == NULL && _map == NULL) ? false : true;
   }
   char * name()
   {
@@ -167,6 +277,7 @@ public:
         de = readdir(_dir);
         if (!de)
           return File();
+        _dirpos++;
 
         if (_name[0] == 0)
           snprintf(path, sizeof(path), "%s", de->d_name);
@@ -186,6 +297,7 @@ public:
   void rewindDirectory(void)
   {
     rewinddir(_dir);
+    _dirpos = 0;
   }
   
   using Print::write;
@@ -215,25 +327,25 @@ public:
   {
     struct stat st;
 
-    return (stat(filepath, &st) < 0) ? false : true;
+    return (stat(sd_path(filepath), &st) < 0) ? false : true;
   }
 
   // Create the requested directory heirarchy--if intermediate directories
   // do not exist they will be created.
   boolean mkdir(char *filepath)
   {
-    return (::mkdir(filepath, 0755) < 0) ? false : true;
+    return (::mkdir(sd_path(filepath), 0755) < 0) ? false : true;
   }
   
   // Delete the file.
   boolean remove(char *filepath)
   {
-    return (::unlink(filepath) < 0) ? false : true;
+    return (::unlink(sd_path(filepath)) < 0) ? false : true;
   }
   
   boolean rmdir(char *filepath)
   {
-    return (::rmdir(filepath) < 0) ? false : true;
+    return (::rmdir(sd_path(filepath)) < 0) ? false : true;
   }
 };
 
@@ -18,16 +18,46 @@
 #ifndef SIMAVR_AVR_PGMSPACE_H
 #define SIMAVR_AVR_PGMSPACE_H
 
+#include <stdint.h>
+#include <string.h>
+
 #define PROGMEM
+#define PGM_P           const char *
+#define PSTR(s)         (s)
 
 char * ltoa (long val, char *s, int radix);
 char * utoa (unsigned int val, char *s, int radix);
 char * ultoa (unsigned long val, char *s, int radix);
 char * itoa (int val, char *s, int radix);
 
-static inline unsigned char pgm_read_byte(const char *c)
+static inline unsigned char pgm_read_byte(const void *c)
+{
+    return *(const unsigned char *)c;
+}
+
+static inline uint16_t pgm_read_word(const void *c)
+{
+    return *(const uint16_t *)c;
+}
+
+static inline uint32_t pgm_read_dword(const void *c)
+{
+    return *(const uint32_t *)c;
+}
+
+static inline float pgm_read_float(const void *c)
+{
+    return *(const float *)c;
+}
+
+static inline size_t strlen_P(const char *s)
+{
+    return strlen(s);
+}
+
+static inline void *memcpy_P(void *dst, const void *src, size_t len)
 {
-    return *c;
+    return memcpy(dst, src, len);
 }
 
 #endif /* SIMAVR_AVR_PGMSPACE_H */
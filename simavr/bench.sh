@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Copyright (C) 2015, Jason S. McMullan
+# All right reserved.
+# Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+#
+# Replay the benchmark corpora through the headless simulator,
+# appending one JSON line per corpus to $O/bench.json
+#
+# Usage: simavr/bench.sh [build-dir]
+
+O=${1:-build-headless}
+SIM=$O/BrundleFab
+DIR=$O/bench
+REPORT=$O/bench.json
+
+set -e
+
+mkdir -p $DIR/sd
+rm -f $REPORT
+
+# Raster ink layer: 8 stripes of 300 dotlines, new pattern each dotline
+awk 'BEGIN {
+    print "G28 X0"
+    print "T1 P0 S4"
+    for (x = 0; x < 8; x++) {
+        printf "G1 X%.2f F2000\n", x * 12.7
+        for (y = 0; y < 300; y++) {
+            printf "T1 P%d\n", (x * 37 + y * 11) % 4096
+            printf "G1 Y%.4f\n", y * 25.4 / 96.0
+        }
+        print "G1 Y0"
+    }
+    print "T0"
+}' > $DIR/raster.gcode
+
+# Sparse ink layer: a small part in the middle of the bed, so
+# most dotlines, and whole stripes, are blank
+awk 'BEGIN {
+    print "G28 X0"
+    print "T1 P0 S4"
+    for (x = 0; x < 8; x++) {
+        printf "G1 X%.2f F2000\n", x * 12.7
+        for (y = 0; y < 300; y++) {
+            if (x >= 3 && x < 5 && y >= 100 && y < 160)
+                printf "T1 P%d\n", 1 + (x * 37 + y * 11) % 4095
+            else
+                print "T1 P0"
+            printf "G1 Y%.4f\n", y * 25.4 / 96.0
+        }
+        print "G1 Y0"
+    }
+    print "T0"
+}' > $DIR/sparse.gcode
+
+# Recoat cycles: drop the bed, feed powder, sweep the roller
+awk 'BEGIN {
+    print "G28 X0"
+    print "G28 Z0"
+    print "G28 E0"
+    for (l = 1; l <= 10; l++) {
+        printf "G1 Z%.2f F600\n", l * 0.2
+        printf "G1 E%.2f F600\n", l * 0.3
+        print "T21"
+        print "G1 X300 F2000"
+        print "G1 X0"
+        print "T0"
+    }
+}' > $DIR/recoat.gcode
+
+# Long Z moves
+awk 'BEGIN {
+    for (i = 0; i < 3; i++) {
+        print "G1 Z100 F2000"
+        print "G1 Z0"
+    }
+}' > $DIR/longz.gcode
+
+# M-code storm: unbuffered commands only
+awk 'BEGIN {
+    for (i = 0; i < 1000; i++) {
+        print "M105"
+        print "M114"
+        print "M115"
+        print "M119"
+        print "M122"
+        printf "M117 line %d\n", i
+    }
+}' > $DIR/mcode.gcode
+
+for corpus in raster sparse recoat longz mcode; do
+    $SIM -s $DIR/sd -g $DIR/$corpus.gcode -b $REPORT -t 3600 >/dev/null
+done
+
+cat $REPORT
@@ -16,15 +16,26 @@
  */
 
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
 
 #include "Arduino.h"
 
 #include <HardwareSerial.h>
 #include <SD.h>
 
+#ifndef SIMAVR_HEADLESS
 #include <SDL.h>
+#endif
 
 #include "main.h"
+#include "timecmp.h"
+#include "InkSim.h"
+#include "LampSim.h"
+#include "pinout.h"
 
 HardwareSerial Serial;
 HardwareSerial Serial2("/dev/ttyACM0");
@@ -32,6 +43,377 @@ HardwareSerial Serial3("/dev/ttyUSB0");
 SDClass SD;
 unsigned long _micros;
 
+static struct {
+    unsigned long activity;     /* Pin, serial and SD events */
+    unsigned long pins;         /* Pin changes and motor steps */
+    unsigned long steps;        /* Motor steps */
+    unsigned long skip;         /* Lose 1 in this many steps (0: none) */
+    unsigned long skipped;      /* Motor steps lost */
+    unsigned long deadline;     /* Earliest deadline this loop */
+    FILE *trace;                /* Full step trace, if any */
+} _sim;
+
+/* Printhead emulators, for Serial2 and Serial3 */
+static InkSim _ink2, _ink3;
+
+/* Fuser lamp emulator */
+static LampSim _lamp;
+
+void simavr_activity(void)
+{
+    _sim.activity++;
+}
+
+void simavr_pin_activity(void)
+{
+    _sim.pins++;
+    _sim.activity++;
+}
+
+/* Returns false if the motor is to lose this step */
+bool simavr_step(void)
+{
+    _sim.steps++;
+    simavr_pin_activity();
+
+    if (_sim.skip && (_sim.steps % _sim.skip) == 0) {
+        _sim.skipped++;
+        return false;
+    }
+
+    return true;
+}
+
+/* Let the simulated peripherals answer, before a serial read */
+void simavr_poll(void)
+{
+    _ink2.update();
+    _ink3.update();
+}
+
+/* Wire a printhead emulator to a serial port, via a socket pair */
+static bool inksim_attach(HardwareSerial *serial, InkSim *ink)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return false;
+    }
+
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    serial->attach(sv[0], sv[0]);
+    ink->begin(sv[1]);
+
+    return true;
+}
+
+/* Every step, in the same format as the M470 trace dump */
+void simavr_trace(uint8_t axis, int dir, unsigned long due, unsigned long at)
+{
+    if (!_sim.trace)
+        return;
+
+    fprintf(_sim.trace, "step %c %c %lu %lu\n",
+            (axis < 4) ? "XYZE"[axis] : '?', (dir < 0) ? '-' : '+', due, at);
+}
+
+void simavr_deadline(unsigned long us)
+{
+    if (time_after(us, _micros) && time_before(us, _sim.deadline))
+        _sim.deadline = us;
+}
+
+#ifdef SIMAVR_HEADLESS
+
+#include "GCode.h"
+
+extern GCode gcode;
+
+/* Longest jump of the virtual clock when nothing is scheduled */
+#define SIMAVR_IDLE_MAX_US      1000
+
+/* Quiet time, after the G-code input ends, before exiting */
+#define SIMAVR_QUIET_US         (2 * 1000000UL)
+
+/* Host loop() period histogram: 10ns buckets, up to 100us */
+#define BENCH_HIST_NS           10
+#define BENCH_HIST_MAX          10000
+
+static struct {
+    FILE *report;
+    unsigned long end_us;       /* End of input, or the last pin change */
+    unsigned long loops;
+    unsigned long long ns_max;
+    unsigned long hist[BENCH_HIST_MAX + 1];
+} _bench;
+
+static unsigned long long nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_loop(unsigned long long ns)
+{
+    unsigned long bucket = ns / BENCH_HIST_NS;
+
+    if (bucket > BENCH_HIST_MAX)
+        bucket = BENCH_HIST_MAX;
+
+    _bench.hist[bucket]++;
+    _bench.loops++;
+    if (ns > _bench.ns_max)
+        _bench.ns_max = ns;
+}
+
+/* Upper bound of the bucket holding the given permille of loops */
+static unsigned long long bench_percentile(unsigned permille)
+{
+    unsigned long long want = (unsigned long long)_bench.loops * permille / 1000;
+    unsigned long long seen = 0;
+
+    for (int i = 0; i < BENCH_HIST_MAX; i++) {
+        seen += _bench.hist[i];
+        if (seen > want)
+            return (i + 1) * BENCH_HIST_NS;
+    }
+
+    return _bench.ns_max;
+}
+
+static double bench_rate(unsigned long count, double seconds)
+{
+    return (seconds > 0) ? count / seconds : 0;
+}
+
+/* Append one JSON object per run, one per line */
+static void bench_report(const char *corpus, unsigned long long host_ns)
+{
+    const struct gcode_stats *stats = gcode.stats();
+    double virtual_s = _bench.end_us / 1000000.0;
+    double host_s = host_ns / 1000000000.0;
+    FILE *f = _bench.report;
+
+    fprintf(f, "{\"corpus\":\"%s\"", corpus);
+    fprintf(f, ",\"virtual_s\":%.6f,\"host_s\":%.6f", virtual_s, host_s);
+    fprintf(f, ",\"lines\":%lu,\"blocks\":%lu,\"steps\":%lu,\"starved\":%lu",
+            stats->lines, stats->blocks, _sim.steps, stats->starved);
+    fprintf(f, ",\"lines_per_s\":%.1f,\"blocks_per_s\":%.1f,\"steps_per_s\":%.1f",
+            bench_rate(stats->lines, virtual_s),
+            bench_rate(stats->blocks, virtual_s),
+            bench_rate(_sim.steps, virtual_s));
+    fprintf(f, ",\"host_lines_per_s\":%.1f,\"host_steps_per_s\":%.1f",
+            bench_rate(stats->lines, host_s),
+            bench_rate(_sim.steps, host_s));
+    fprintf(f, ",\"loops\":%lu,\"loop_ns_p50\":%llu,\"loop_ns_p90\":%llu"
+               ",\"loop_ns_p99\":%llu,\"loop_ns_p999\":%llu,\"loop_ns_max\":%llu}\n",
+            _bench.loops, bench_percentile(500), bench_percentile(900),
+            bench_percentile(990), bench_percentile(999), _bench.ns_max);
+
+    if (f != stderr)
+        fclose(f);
+    _bench.report = NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s sdroot] [-g input.gcode] [-2 device] [-3 device] [-l loop_us] [-t seconds] [-b report] [-T trace] [-d usec] [-e N] [-k N]\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  -s sdroot        Directory to use as the SD card root\n");
+    fprintf(stderr, "  -g input.gcode   G-code to feed to the console (default stdin)\n");
+    fprintf(stderr, "  -2 device        Device or pty for Serial2 (default: emulated printhead)\n");
+    fprintf(stderr, "  -3 device        Device or pty for Serial3 (default: emulated printhead)\n");
+    fprintf(stderr, "  -l loop_us       Virtual time charged per busy loop (default 50)\n");
+    fprintf(stderr, "  -t seconds       Stop after this much virtual time\n");
+    fprintf(stderr, "  -b report        Append benchmark results, as JSON, to a file ('-' for stderr)\n");
+    fprintf(stderr, "  -T trace         Write every step event to a file (see simavr/trace.awk)\n");
+    fprintf(stderr, "  -d usec          Extra printhead emulator reply latency\n");
+    fprintf(stderr, "  -e N             Drop or corrupt 1 in N printhead emulator replies\n");
+    fprintf(stderr, "  -k N             Lose 1 in N stepper motor steps\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL;
+    const char *sdroot = NULL;
+    const char *report = NULL;
+    char corpus[256];
+    unsigned long loop_us = 50;
+    unsigned long limit_us = 0;
+    unsigned long quiet, eof_us = 0;
+    unsigned long long host_ns;
+    bool device[4] = { false, false, false, false };
+    unsigned long ink_latency = 0;
+    unsigned ink_errors = 0;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "s:g:2:3:l:t:b:T:d:e:k:h")) != -1) {
+        switch (opt) {
+        case '2':
+        case '3':
+            fd = open(optarg, O_RDWR | O_NONBLOCK);
+            if (fd < 0) {
+                perror(optarg);
+                return EXIT_FAILURE;
+            }
+            if (opt == '2')
+                Serial2.attach(fd, fd);
+            else
+                Serial3.attach(fd, fd);
+            device[opt - '0'] = true;
+            break;
+        case 's': sdroot = optarg; break;
+        case 'g': input = optarg; break;
+        case 'l': loop_us = strtoul(optarg, NULL, 0); break;
+        case 't': limit_us = strtoul(optarg, NULL, 0) * 1000000UL; break;
+        case 'b': report = optarg; break;
+        case 'd': ink_latency = strtoul(optarg, NULL, 0); break;
+        case 'e': ink_errors = strtoul(optarg, NULL, 0); break;
+        case 'k': _sim.skip = strtoul(optarg, NULL, 0); break;
+        case 'T':
+            _sim.trace = fopen(optarg, "w");
+            if (!_sim.trace) {
+                perror(optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default: usage(argv[0]); break;
+        }
+    }
+
+    /* Emulate a printhead on any port without a device */
+    if (!device[2] && !inksim_attach(&Serial2, &_ink2))
+        return EXIT_FAILURE;
+    if (!device[3] && !inksim_attach(&Serial3, &_ink3))
+        return EXIT_FAILURE;
+
+    _ink2.latency_set(ink_latency);
+    _ink3.latency_set(ink_latency);
+    _ink2.error_set(ink_errors);
+    _ink3.error_set(ink_errors);
+
+    fd = 0;
+    snprintf(corpus, sizeof(corpus), "stdin");
+    if (input && strcmp(input, "-") != 0) {
+        fd = open(input, O_RDONLY);
+        if (fd < 0) {
+            perror(input);
+            return EXIT_FAILURE;
+        }
+        /* Name the corpus after the input file, less its extension */
+        const char *name = strrchr(input, '/');
+        snprintf(corpus, sizeof(corpus), "%s", name ? name + 1 : input);
+        char *ext = strrchr(corpus, '.');
+        if (ext)
+            *ext = 0;
+    }
+
+    if (report) {
+        if (strcmp(report, "-") == 0)
+            _bench.report = stderr;
+        else
+            _bench.report = fopen(report, "a");
+        if (!_bench.report) {
+            perror(report);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* After opening the input, so relative paths still work */
+    if (sdroot && chdir(sdroot) < 0) {
+        perror(sdroot);
+        return EXIT_FAILURE;
+    }
+
+    Serial.attach(fd, 1);
+
+    /* No joystick key pressed */
+    analogWrite(4, 700);
+
+#ifdef FUSER_TEMP_ADC
+    _lamp.begin(FUSER_ENABLE, FUSER_TEMP_ADC);
+#endif
+
+    setup();
+
+    host_ns = nsec();
+    quiet = _micros;
+    while (!limit_us || time_before(_micros, limit_us)) {
+        unsigned long activity = _sim.activity;
+        unsigned long pins = _sim.pins;
+        unsigned long lines = gcode.stats()->lines;
+
+        _sim.deadline = _micros + SIMAVR_IDLE_MAX_US;
+
+        if (_bench.report) {
+            unsigned long long ns = nsec();
+            loop();
+            bench_loop(nsec() - ns);
+        } else {
+            loop();
+        }
+        _lamp.update();
+
+        /* Busy loops cost time, idle ones skip to the next event */
+        if (_sim.activity != activity)
+            _micros += loop_us;
+        else if (time_after(_sim.deadline, _micros))
+            _micros = _sim.deadline;
+
+        /* Motion, G-code still being run from SD, or queued blocks
+         * (ie waiting on the fuser) are not quiet
+         */
+        if (_sim.pins != pins || gcode.stats()->lines != lines ||
+            gcode.queue_used() > 0)
+            quiet = _micros;
+
+        if (!Serial.eof())
+            continue;
+
+        if (!eof_us)
+            eof_us = _micros;
+
+        if (time_after(_micros, quiet + SIMAVR_QUIET_US))
+            break;
+    }
+    host_ns = nsec() - host_ns;
+
+    /* The job ends at the end of input, or its last motion */
+    if (!eof_us)
+        _bench.end_us = _micros;
+    else if (time_after(quiet, eof_us))
+        _bench.end_us = quiet;
+    else
+        _bench.end_us = eof_us;
+
+    Serial.end();
+
+    if (_sim.trace)
+        fclose(_sim.trace);
+
+    fprintf(stderr, "simavr: %lu.%06lu s virtual, %lu pin changes\n",
+            _micros / 1000000, _micros % 1000000, _sim.pins);
+    if (_sim.skip)
+        fprintf(stderr, "Steppers: %lu of %lu steps lost\n",
+                _sim.skipped, _sim.steps);
+    _ink2.report(stderr, "Serial2 printhead");
+    _ink3.report(stderr, "Serial3 printhead");
+    _lamp.report(stderr, "Fuser lamp");
+
+    if (_bench.report)
+        bench_report(corpus, host_ns);
+
+    return EXIT_SUCCESS;
+}
+
+#else /* !SIMAVR_HEADLESS */
+
 static unsigned long msec(void)
 {
     struct timeval tv;
@@ -57,6 +439,13 @@ int main(int argc, char **argv)
 
     SDL_Init(SDL_INIT_VIDEO);
 
+    inksim_attach(&Serial2, &_ink2);
+    inksim_attach(&Serial3, &_ink3);
+
+#ifdef FUSER_TEMP_ADC
+    _lamp.begin(FUSER_ENABLE, FUSER_TEMP_ADC);
+#endif
+
     setup();
     do {
         unsigned long now = msec();
@@ -64,6 +453,7 @@ int main(int argc, char **argv)
 
         _micros+=137;
         loop();
+        _lamp.update();
 
         if (update_timeout < now) {
             if (_update.gui) {
@@ -97,4 +487,6 @@ int main(int argc, char **argv)
     Serial.end();
 }
 
+#endif /* SIMAVR_HEADLESS */
+
 /* vim: set shiftwidth=4 expandtab:  */
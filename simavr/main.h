@@ -18,6 +18,7 @@
 #ifndef SIMAVR_MAIN_H
 #define SIMAVR_MAIN_H
 
+#ifndef SIMAVR_HEADLESS
 #include <SDL.h>
 
 extern "C" {
@@ -25,8 +26,15 @@ extern "C" {
 void simavr_update_gui(SDL_Surface *surf);
 
 };
+#endif
+
+/* Virtual time charged for each read of the headless clock */
+#define SIMAVR_CLOCK_READ_US    1
 
 extern unsigned long _micros;
 
+/* Current time, without charging for the clock read */
+unsigned long simavr_now(void);
+
 #endif /* SIMAVR_MAIN_H */
 /* vim: set shiftwidth=4 expandtab:  */
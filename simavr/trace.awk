@@ -0,0 +1,94 @@
+#!/usr/bin/awk -f
+#
+# Copyright (C) 2015, Jason S. McMullan
+# All right reserved.
+# Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+#
+# Step trace analysis, for M470 dumps or the simulator's -T trace.
+#
+# Usage: awk -f simavr/trace.awk [-v late=100] [-v gap=100000] trace.txt
+#
+# Per axis, reports histograms (log2 usec buckets) of:
+#   late   - how long after its due time each step was issued
+#   jitter - |issued interval - scheduled interval| between
+#            consecutive steps in the same direction
+# and counts the steps that missed their deadline by more than
+# 'late' usec. Intervals longer than 'gap' usec are the start of
+# a new move, and are not counted as jitter.
+
+function bucket(us,    b) {
+    if (us < 1)
+        return 0
+    for (b = 1; us >= 2 && b < 11; b++)
+        us /= 2
+    return b
+}
+
+function label(b) {
+    if (b <= 1)
+        return b ""
+    if (b == 11)
+        return ">=1024"
+    return sprintf("%d-%d", 2^(b-1), 2^b - 1)
+}
+
+BEGIN {
+    if (late == "")
+        late = 100
+    if (gap == "")
+        gap = 100000
+}
+
+$1 == "step" && NF == 5 {
+    axis = $2
+    due = $4
+    at = $5
+
+    if (!(axis in steps))
+        order[++axes] = axis
+    steps[axis]++
+
+    slip = at - due
+    if (slip < 0)
+        slip = 0
+    hlate[axis, bucket(slip)]++
+    if (slip > late)
+        missed[axis]++
+
+    if ((axis in last_at) && last_dir[axis] == $3 && due - last_due[axis] <= gap) {
+        jitter = (at - last_at[axis]) - (due - last_due[axis])
+        if (jitter < 0)
+            jitter = -jitter
+        hjitter[axis, bucket(jitter)]++
+        intervals[axis]++
+    }
+
+    last_at[axis] = at
+    last_due[axis] = due
+    last_dir[axis] = $3
+}
+
+END {
+    for (n = 1; n <= axes; n++) {
+        axis = order[n]
+        printf "axis %s: %d steps, %d intervals, %d missed (> %d us late)\n",
+               axis, steps[axis], intervals[axis], missed[axis], late
+        printf "  %-10s %10s %10s\n", "usec", "late", "jitter"
+        for (b = 0; b <= 11; b++) {
+            if (!hlate[axis, b] && !hjitter[axis, b])
+                continue
+            printf "  %-10s %10d %10d\n", label(b), hlate[axis, b], hjitter[axis, b]
+        }
+    }
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2015, Jason S. McMullan
+ * All right reserved.
+ * Author: Jason S. McMullan <jason.mcmullan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef TIMECMP_H
+#define TIMECMP_H
+
+/* Wrap-safe comparison of micros() or millis() timestamps */
+#define time_after(a, b)        ((long)((b) - (a)) < 0)
+#define time_before(a, b)       time_after(b, a)
+
+/* Note that something is scheduled at micros() time 'us'.
+ *
+ * The headless simulator uses this to jump its virtual clock
+ * straight to the next event. On hardware it does nothing.
+ */
+#ifdef __SIMAVR__
+extern void simavr_deadline(unsigned long us);
+#define time_deadline(us)       simavr_deadline(us)
+#else
+#define time_deadline(us)       do { } while (0)
+#endif
+
+#endif /* TIMECMP_H */
+/* vim: set shiftwidth=4 expandtab:  */